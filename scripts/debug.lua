@@ -44,6 +44,24 @@ function module:on_init()
       end
   )
 
+  get_module("console"):create_command(
+      "print_resource_profiles",
+      function()
+        for index, line in ipairs(get_resource_profiles()) do
+          get_module("console"):log(line)
+        end
+      end
+  )
+
+  get_module("console"):create_command(
+      "print_resource_memory",
+      function()
+        for index, line in ipairs(get_resource_memory()) do
+          get_module("console"):log(line)
+        end
+      end
+  )
+
   get_module("console"):create_command(
       "toggle_day_night",
       function()
@@ -54,6 +72,8 @@ end
 
 function module:on_done()
   -- Unregister console commands.
+  get_module("console"):delete_command("print_resource_profiles")
+  get_module("console"):delete_command("print_resource_memory")
   get_module("console"):delete_command("toggle_day_night")
   get_module("console"):delete_command("set_style")
 
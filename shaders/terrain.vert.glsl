@@ -1,18 +1,40 @@
 #version 410
 
-// Uniforms.
-uniform vec3 light;
-uniform mat4 modelview_matrix;
-uniform mat3 normal_matrix;
-uniform mat4 projection_matrix;
-uniform vec3 slice_normal;
-uniform vec3 slice_tangent;
-uniform vec3 slice_cotangent;
+// Per frame uniforms shared by all shards (see TerrainFrameUniforms).
+layout(std140) uniform FrameUniforms {
+  mat4 projection_matrix;
+  mat4 modelview_matrix;
+  mat4 frame_normal_matrix;
+  vec4 frame_light;
+};
+
+// Slice surface vectors indexed by slice direction (see TerrainSliceDir).
+const vec3 slice_normals[6] = vec3[6](
+    vec3(-1, 0, 0),
+    vec3(1, 0, 0),
+    vec3(0, -1, 0),
+    vec3(0, 1, 0),
+    vec3(0, 0, -1),
+    vec3(0, 0, 1));
+const vec3 slice_tangents[6] = vec3[6](
+    vec3(0, 0, 1),
+    vec3(0, 0, -1),
+    vec3(0, 0, -1),
+    vec3(0, 0, 1),
+    vec3(-1, 0, 0),
+    vec3(1, 0, 0));
+const vec3 slice_cotangents[6] = vec3[6](
+    vec3(0, 1, 0),
+    vec3(0, 1, 0),
+    vec3(1, 0, 0),
+    vec3(1, 0, 0),
+    vec3(0, 1, 0),
+    vec3(0, 1, 0));
 
 // Vertex attributes.
 in vec3 position;
 in vec3 color;
-in vec3 normal;
+in vec3 normal;  // The occlusion and slice direction.
 in vec2 tex_coord;
 
 // Varying output to the fragment shader. All of the spatial outputs
@@ -31,6 +53,12 @@ out float _normal_layer;
 out float _lightness;
 
 void main() {
+  mat3 normal_matrix = mat3(frame_normal_matrix);
+  vec3 light = frame_light.xyz;
+  int slice_dir = int(normal.y + 0.5);
+  vec3 slice_normal = slice_normals[slice_dir];
+  vec3 slice_tangent = slice_tangents[slice_dir];
+  vec3 slice_cotangent = slice_cotangents[slice_dir];
   vec4 view_position = modelview_matrix * vec4(position, 1.0);
 
   // Set the vertex position on the screen.
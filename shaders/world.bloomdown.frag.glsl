@@ -0,0 +1,22 @@
+#version 410
+
+// Uniforms.
+uniform sampler2D color_map;
+
+// Interpolated vertex input.
+in vec2 _tex_coord;
+
+// Output fragment color.
+out vec4 color;
+
+// Dual filter (Kawase) downsample. The diagonal taps fall between texels of
+// the source map so that bilinear filtering averages four texels per tap.
+void main() {
+  vec2 half_pixel = 0.5 / textureSize(color_map, 0);
+  color = 4.0 * texture(color_map, _tex_coord);
+  color += texture(color_map, _tex_coord + vec2(-half_pixel.x, -half_pixel.y));
+  color += texture(color_map, _tex_coord + vec2(half_pixel.x, -half_pixel.y));
+  color += texture(color_map, _tex_coord + vec2(-half_pixel.x, half_pixel.y));
+  color += texture(color_map, _tex_coord + vec2(half_pixel.x, half_pixel.y));
+  color /= 8.0;
+}
@@ -0,0 +1,27 @@
+#version 410
+
+// Uniforms.
+uniform sampler2D color_map;
+
+// Interpolated vertex input.
+in vec2 _tex_coord;
+
+// Output fragment color.
+out vec4 color;
+
+// Dual filter (Kawase) upsample. Taps on a ring around the fragment spread the
+// glow by one source texel per level while bilinear filtering smooths it.
+void main() {
+  vec2 half_pixel = 0.5 / textureSize(color_map, 0);
+  vec2 dx = vec2(half_pixel.x, 0.0);
+  vec2 dy = vec2(0.0, half_pixel.y);
+  color = texture(color_map, _tex_coord - 2.0 * dx);
+  color += texture(color_map, _tex_coord + 2.0 * dx);
+  color += texture(color_map, _tex_coord - 2.0 * dy);
+  color += texture(color_map, _tex_coord + 2.0 * dy);
+  color += 2.0 * texture(color_map, _tex_coord - dx - dy);
+  color += 2.0 * texture(color_map, _tex_coord + dx - dy);
+  color += 2.0 * texture(color_map, _tex_coord - dx + dy);
+  color += 2.0 * texture(color_map, _tex_coord + dx + dy);
+  color /= 12.0;
+}
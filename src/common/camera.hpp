@@ -1,10 +1,18 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <boost/optional.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "src/common/spatial.hpp"
 
@@ -47,79 +55,420 @@ inline auto frustumVolume(const Camera& camera) {
   return s * (f * f * f - n * n * n);
 }
 
-inline auto computeVisibleCells(const Camera& camera, const Octree& octree) {
-  // Create an Eigen matrix mapping octree vertices to clip coordinates.
-  Eigen::Matrix4f pv_mat;
-  {
-    auto view_proj = camera.projectionMatrix() * camera.viewMatrix();
-    for (int col = 0; col < 4; col += 1) {
-      for (int row = 0; row < 4; row += 1) {
-        pv_mat(row, col) = view_proj[col][row];
+// Returns the planes bounding the camera's frustum scaled by the softness in
+// clip coordinates (i.e. -softness * w <= x, y, z <= softness * w). A point p
+// is inside a plane if dot(plane, (p, 1)) >= 0.
+inline auto frustumPlanes(const Camera& camera, float softness = 1.0f) {
+  auto view_proj = camera.projectionMatrix() * camera.viewMatrix();
+  auto row = [&](int i) {
+    return Eigen::Vector4f(
+        view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+  };
+  std::array<Eigen::Vector4f, 6> ret;
+  for (int i = 0; i < 3; i += 1) {
+    ret[2 * i] = softness * row(3) + row(i);
+    ret[2 * i + 1] = softness * row(3) - row(i);
+  }
+  return ret;
+}
+
+// Returns the minimum set of octree cells covering the camera's frustum. The
+// children of each visited cell are tested against the frustum planes as one
+// batch of boxes using their nearest and farthest corners to each plane (i.e.
+// n-vertex and p-vertex). Planes that contain a cell are skipped for its
+// descendants. Cells summarized as empty are culled when given occupancy.
+inline auto computeVisibleCells(
+    const Camera& camera,
+    const Octree& octree,
+    const OctreeOccupancy* occupancy = nullptr) {
+  using Lanes = Eigen::Array<float, 8, 1>;
+  using LaneMasks = Eigen::Array<int, 8, 1>;
+  constexpr int kAllPlanes = (1 << 6) - 1;
+
+  // A cell is culled if it's outside of a frustum plane and emitted if it's
+  // entirely inside a slightly larger frustum.
+  constexpr auto kSoftness = 1.2f;
+  auto planes = frustumPlanes(camera);
+  auto soft_planes = frustumPlanes(camera, kSoftness);
+
+  // A batch of boxes with one box per lane.
+  struct Boxes {
+    Lanes x0, y0, z0, x1, y1, z1;
+  };
+
+  // Returns a mask of the planes (among those in the given mask) containing
+  // each box. Boxes outside of any plane are flagged as culled.
+  auto test_planes = [](const std::array<Eigen::Vector4f, 6>& planes,
+                        int mask,
+                        bool strict,
+                        const Boxes& boxes,
+                        LaneMasks& culled) {
+    const auto& [x0, y0, z0, x1, y1, z1] = boxes;
+    LaneMasks ret = LaneMasks::Zero();
+    for (int i = 0; i < 6; i += 1) {
+      if (!(mask >> i & 1)) {
+        continue;
+      }
+      const auto& p = planes[i];
+      Lanes p_dist = p[3] + p[0] * (p[0] > 0 ? x1 : x0) +
+          p[1] * (p[1] > 0 ? y1 : y0) + p[2] * (p[2] > 0 ? z1 : z0);
+      Lanes n_dist = p[3] + p[0] * (p[0] > 0 ? x0 : x1) +
+          p[1] * (p[1] > 0 ? y0 : y1) + p[2] * (p[2] > 0 ? z0 : z1);
+      culled = culled.max((p_dist < 0).cast<int>());
+      auto inside = strict ? (n_dist > 0).eval() : (n_dist >= 0).eval();
+      ret += inside.cast<int>() * (1 << i);
+    }
+    return ret;
+  };
+
+  // The minimum corner offsets of each child cell in units of its size.
+  static const Lanes kChildX = (Lanes() << 0, 1, 0, 1, 0, 1, 0, 1).finished();
+  static const Lanes kChildY = (Lanes() << 0, 0, 1, 1, 0, 0, 1, 1).finished();
+  static const Lanes kChildZ = (Lanes() << 0, 0, 0, 0, 1, 1, 1, 1).finished();
+
+  struct Visit {
+    int64_t cell;
+    int level;
+    float x, y, z, size;
+    int planes;
+    int soft_planes;
+  };
+
+  // Recursively identify the minimum cell set visible to the camera. Each
+  // batch holds the children of a visible cell (or the root cell alone).
+  std::vector<int64_t> ret;
+  std::vector<Visit> stack;
+  auto visit_batch = [&](const Visit& parent,
+                         int64_t first_cell,
+                         int count,
+                         int level,
+                         const Lanes& x0,
+                         const Lanes& y0,
+                         const Lanes& z0,
+                         float size) {
+    Boxes boxes{x0, y0, z0, x0 + size, y0 + size, z0 + size};
+    LaneMasks culled = LaneMasks::Zero();
+    LaneMasks soft_culled = LaneMasks::Zero();
+    LaneMasks inside =
+        test_planes(planes, parent.planes, false, boxes, culled);
+    LaneMasks soft_inside =
+        test_planes(soft_planes, parent.soft_planes, true, boxes, soft_culled);
+    for (int i = 0; i < count; i += 1) {
+      int64_t cell = first_cell + i;
+      if (culled[i] ||
+          (occupancy && occupancy->get(cell) == Occupancy::EMPTY)) {
+        continue;
+      }
+
+      // Emit the cell and stop recursion if it's on the bottom-most level or
+      // if the bounding box is almost entirely inside the frustum.
+      int soft_mask = parent.soft_planes & ~soft_inside[i];
+      if (level + 1 >= static_cast<int>(octree.treeDepth()) || !soft_mask) {
+        ret.push_back(cell);
+      } else {
+        int mask = parent.planes & ~inside[i];
+        stack.push_back(
+            {cell, level, x0[i], y0[i], z0[i], size, mask, soft_mask});
       }
     }
+  };
+
+  float root_size = octree.size();
+  Visit root{0, 0, 0, 0, 0, root_size, kAllPlanes, kAllPlanes};
+  Lanes zeros = Lanes::Zero();
+  visit_batch(root, 0, 1, 0, zeros, zeros, zeros, root_size);
+  while (stack.size()) {
+    auto parent = stack.back();
+    stack.pop_back();
+    auto size = 0.5f * parent.size;
+    visit_batch(
+        parent,
+        8 * parent.cell + 1,
+        8,
+        parent.level + 1,
+        parent.x + size * kChildX,
+        parent.y + size * kChildY,
+        parent.z + size * kChildZ,
+        size);
   }
+  return ret;
+}
 
-  // Create a matrix to use to store octree cell vertices.
-  Eigen::Matrix<float, 4, 8> bb_mat;
-  bb_mat.setOnes();
-  {
-    for (int z = 0; z < 2; z += 1) {
-      for (int y = 0; y < 2; y += 1) {
-        for (int x = 0; x < 2; x += 1) {
-          bb_mat(0, x + y * 2 + z * 4) = x;
-          bb_mat(1, x + y * 2 + z * 4) = y;
-          bb_mat(2, x + y * 2 + z * 4) = z;
-        }
+// The cells added and removed by an update of a VisibleCellSet. Versions are
+// unique across sets so that the deltas only apply on top of the previous
+// version. Snapshots of a set have no previous version and add all its cells.
+struct VisibleCellsUpdate {
+  uint64_t previous_version;
+  uint64_t version;
+  std::vector<int64_t> added;
+  std::vector<int64_t> removed;
+  size_t retested;
+};
+
+// Incrementally maintains the cells visible to a moving camera (i.e. the
+// cells of computeVisibleCells). Each visited cell remembers how far the
+// frustum planes may move before its classification, or that of any cell in
+// its subtree, could change. Planes are rigidly attached to the camera so that
+// distance is bounded by the camera's motion and only subtrees near the
+// frustum boundary are visited when the camera moves continuously. Cells
+// summarized as empty are always culled.
+class VisibleCellSet {
+ public:
+  VisibleCellSet(
+      Octree octree, std::shared_ptr<const OctreeOccupancy> occupancy = nullptr)
+      : octree_(std::move(octree)),
+        occupancy_(std::move(occupancy)),
+        version_(0),
+        translation_(0.0),
+        rotation_norm_(0.0) {}
+
+  VisibleCellsUpdate update(const Camera& camera) {
+    static std::atomic<uint64_t> next_version(1);
+    std::lock_guard lock(mutex_);
+    VisibleCellsUpdate ret{version_, next_version++};
+    version_ = ret.version;
+
+    // Accumulate how far the camera has moved and rotated in total so that
+    // nodes can bound how far the planes moved since they were last visited.
+    auto rotation = glm::mat3(camera.viewMatrix());
+    if (camera_ && sameProjection(*camera_, camera)) {
+      float rotation_norm = 0.0f;
+      for (int i = 0; i < 3; i += 1) {
+        auto delta = rotation[i] - rotation_[i];
+        rotation_norm += glm::dot(delta, delta);
       }
+      translation_ += glm::length(camera.position - camera_->position);
+      rotation_norm_ += std::sqrt(rotation_norm);
+    } else {
+      reset(ret);
     }
+    camera_ = camera;
+    rotation_ = rotation;
+    planes_ = normalized(frustumPlanes(camera));
+    soft_planes_ = normalized(frustumPlanes(camera, kSoftness));
+    visit(0, ret);
+    return ret;
   }
 
-  // Recursively identify the minimum cell set visible to the camera.
-  std::vector<int64_t> ret;
-  octree.search([&](int64_t cell) {
-    auto cell_box = octree.cellBox(cell);
-
-    Eigen::Matrix4f tr_mat;
-    tr_mat.setIdentity();
-    tr_mat(0, 3) = std::get<0>(cell_box);
-    tr_mat(1, 3) = std::get<1>(cell_box);
-    tr_mat(2, 3) = std::get<2>(cell_box);
-    tr_mat(0, 0) = std::get<3>(cell_box) - std::get<0>(cell_box);
-    tr_mat(1, 1) = std::get<4>(cell_box) - std::get<1>(cell_box);
-    tr_mat(2, 2) = std::get<5>(cell_box) - std::get<2>(cell_box);
-
-    // Map the cell's bounding box matrix into clip coordinates
-    Eigen::Array<float, 4, 8> clip = pv_mat * tr_mat * bb_mat;
-
-    // We conclude that a cell does not intersect the frustum if all of the 8
-    // bounding-box vertices are strictly outside one of the clip planes.
-    if ((clip.row(0) < -clip.row(3)).all() ||
-        (clip.row(0) > clip.row(3)).all() ||
-        (clip.row(1) < -clip.row(3)).all() ||
-        (clip.row(1) > clip.row(3)).all() ||
-        (clip.row(2) < -clip.row(3)).all() ||
-        (clip.row(2) > clip.row(3)).all()) {
-      return false;
+  // Returns all of the visible cells as of the latest update.
+  VisibleCellsUpdate snapshot() {
+    std::lock_guard lock(mutex_);
+    return VisibleCellsUpdate{0, version_, cells_, {}, 0};
+  }
+
+ private:
+  static constexpr auto kSoftness = 1.2f;
+  static constexpr auto kMinSlack = 1e-3f;
+
+  enum State { CULLED, EMITTED, EXPANDED };
+
+  // The classification of a visited cell along with its slack and the minimum
+  // slack of its subtree as of when it was last visited. The total camera
+  // motion and the distance to the camera at that time bound how much either
+  // may have decreased since.
+  struct Node {
+    State state;
+    float slack;
+    float subtree_slack;
+    glm::vec3 center;
+    float radius;
+    float distance;
+    double translation;
+    double rotation_norm;
+  };
+
+  using Planes = std::array<Eigen::Vector4f, 6>;
+
+  static bool sameProjection(const Camera& a, const Camera& b) {
+    return a.fov == b.fov && a.aspect == b.aspect &&
+        a.near_distance == b.near_distance && a.far_distance == b.far_distance;
+  }
+
+  static Planes normalized(Planes planes) {
+    for (auto& plane : planes) {
+      plane /= plane.head<3>().norm();
     }
+    return planes;
+  }
 
-    // Emit the cell and stop recursion if it's on the bottom-most level or if
-    // the bounding box is almost entirely inside the frustum.
-    constexpr auto softness = 1.2f;
-    if ((octree.cellLevel(cell) + 1 >= octree.treeDepth()) ||
-        ((clip.row(0) > -softness * clip.row(3)).all() &&
-         (clip.row(0) < softness * clip.row(3)).all() &&
-         (clip.row(1) > -softness * clip.row(3)).all() &&
-         (clip.row(1) < softness * clip.row(3)).all() &&
-         (clip.row(2) > -softness * clip.row(3)).all() &&
-         (clip.row(2) < softness * clip.row(3)).all())) {
-      ret.push_back(cell);
-      return false;
+  // Returns the cell's classification by computeVisibleCells along with the
+  // minimum distance any plane must move for the classification to change.
+  Node classify(int64_t cell) const {
+    auto [x0, y0, z0, x1, y1, z1] = octree_.cellBox(cell);
+    Eigen::Vector3f lo(x0, y0, z0), hi(x1, y1, z1);
+    Node ret;
+    auto center = 0.5f * (lo + hi);
+    ret.center = glm::vec3(center[0], center[1], center[2]);
+    ret.radius = 0.5f * (hi - lo).norm();
+    if (occupancy_ && occupancy_->get(cell) == Occupancy::EMPTY) {
+      ret.state = CULLED;
+      ret.slack = std::numeric_limits<float>::infinity();
+      return ret;
     }
 
-    return true;
-  });
+    auto near_far = [&](const Eigen::Vector4f& plane) {
+      Eigen::Vector3f p, n;
+      for (int i = 0; i < 3; i += 1) {
+        p[i] = plane[i] > 0 ? hi[i] : lo[i];
+        n[i] = plane[i] > 0 ? lo[i] : hi[i];
+      }
+      return std::pair(
+          plane.head<3>().dot(p) + plane[3], plane.head<3>().dot(n) + plane[3]);
+    };
 
-  return ret;
-}
+    // Distances from the farthest corners to the frustum planes and from the
+    // nearest corners to the soft frustum planes.
+    float min_p_dist = std::numeric_limits<float>::infinity();
+    float max_outside = -std::numeric_limits<float>::infinity();
+    for (const auto& plane : planes_) {
+      auto p_dist = near_far(plane).first;
+      min_p_dist = std::min(min_p_dist, p_dist);
+      max_outside = std::max(max_outside, -p_dist);
+    }
+    float min_soft_n_dist = std::numeric_limits<float>::infinity();
+    for (const auto& plane : soft_planes_) {
+      min_soft_n_dist = std::min(min_soft_n_dist, near_far(plane).second);
+    }
+
+    if (min_p_dist < 0) {
+      ret.state = CULLED;
+      ret.slack = max_outside;
+    } else if (
+        octree_.cellLevel(cell) + 1 >= static_cast<int>(octree_.treeDepth())) {
+      ret.state = EMITTED;
+      ret.slack = min_p_dist;
+    } else if (min_soft_n_dist > 0) {
+      ret.state = EMITTED;
+      ret.slack = std::min(min_p_dist, min_soft_n_dist);
+    } else {
+      ret.state = EXPANDED;
+      ret.slack = std::min(min_p_dist, -min_soft_n_dist);
+    }
+    return ret;
+  }
+
+  // Returns a bound on how far any plane may have moved relative to the
+  // node's bounding sphere since it was last visited. A point at distance r
+  // from the camera moves by at most translation + rotation * r relative to
+  // the planes per update, and the camera stayed within the total translation
+  // of its position at the time. Bounding spheres of descendants are nested
+  // in those of their ancestors so this also bounds the whole subtree.
+  float motion(const Node& node) const {
+    auto translation = static_cast<float>(translation_ - node.translation);
+    auto rotation_norm =
+        static_cast<float>(rotation_norm_ - node.rotation_norm);
+    return translation +
+        rotation_norm * (node.distance + translation + node.radius);
+  }
+
+  // Re-tests the cells of the subtree whose slack may have run out, applying
+  // any change to the visible set, and returns the subtree's remaining slack.
+  // Subtrees with enough slack left are skipped entirely.
+  float visit(int64_t cell, VisibleCellsUpdate& update) {
+    auto it = nodes_.find(cell);
+    boost::optional<Node> old_node;
+    if (it != nodes_.end()) {
+      auto motion_bound = motion(it->second);
+      if (it->second.subtree_slack - motion_bound > kMinSlack) {
+        return it->second.subtree_slack - motion_bound;
+      }
+      old_node = it->second;
+      old_node->slack -= motion_bound;
+    }
+
+    // Classify the cell unless it still has slack and apply any change.
+    Node node;
+    if (old_node && old_node->slack > kMinSlack) {
+      node = *old_node;
+    } else {
+      auto old_state = old_node ? old_node->state : CULLED;
+      node = classify(cell);
+      update.retested += 1;
+      if (old_state == EXPANDED && node.state != EXPANDED) {
+        pruneChildren(cell, update);
+      }
+      if (old_state == EMITTED && node.state != EMITTED) {
+        removeCell(cell, update);
+      } else if (old_state != EMITTED && node.state == EMITTED) {
+        addCell(cell, update);
+      }
+    }
+
+    node.subtree_slack = node.slack;
+    if (node.state == EXPANDED) {
+      for (int i = 0; i < 8; i += 1) {
+        auto child_slack = visit(8 * cell + 1 + i, update);
+        node.subtree_slack = std::min(node.subtree_slack, child_slack);
+      }
+    }
+    node.distance = glm::length(node.center - camera_->position);
+    node.translation = translation_;
+    node.rotation_norm = rotation_norm_;
+    nodes_[cell] = node;
+    return node.subtree_slack;
+  }
+
+  void pushChildren(int64_t cell, std::vector<int64_t>& stack) const {
+    for (int i = 0; i < 8; i += 1) {
+      stack.push_back(8 * cell + 1 + i);
+    }
+  }
+
+  // Forgets all descendants of the cell.
+  void pruneChildren(int64_t cell, VisibleCellsUpdate& update) {
+    std::vector<int64_t> stack;
+    pushChildren(cell, stack);
+    while (stack.size()) {
+      auto child = stack.back();
+      stack.pop_back();
+      auto it = nodes_.find(child);
+      if (it == nodes_.end()) {
+        continue;
+      }
+      if (it->second.state == EMITTED) {
+        removeCell(child, update);
+      } else if (it->second.state == EXPANDED) {
+        pushChildren(child, stack);
+      }
+      nodes_.erase(it);
+    }
+  }
+
+  void reset(VisibleCellsUpdate& update) {
+    update.removed = std::move(cells_);
+    cells_.clear();
+    indices_.clear();
+    nodes_.clear();
+  }
+
+  void addCell(int64_t cell, VisibleCellsUpdate& update) {
+    indices_[cell] = cells_.size();
+    cells_.push_back(cell);
+    update.added.push_back(cell);
+  }
+
+  void removeCell(int64_t cell, VisibleCellsUpdate& update) {
+    auto index = indices_.at(cell);
+    indices_[cells_.back()] = index;
+    cells_[index] = cells_.back();
+    cells_.pop_back();
+    indices_.erase(cell);
+    update.removed.push_back(cell);
+  }
+
+  std::mutex mutex_;
+  Octree octree_;
+  std::shared_ptr<const OctreeOccupancy> occupancy_;
+  uint64_t version_;
+  boost::optional<Camera> camera_;
+  glm::mat3 rotation_;
+  Planes planes_;
+  Planes soft_planes_;
+  std::unordered_map<int64_t, Node> nodes_;
+  std::unordered_map<int64_t, size_t> indices_;
+  std::vector<int64_t> cells_;
+  double translation_;
+  double rotation_norm_;
+};
 
 }  // namespace tequila
\ No newline at end of file
@@ -2,15 +2,20 @@
 
 #include <boost/optional.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <exception>
 #include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <vector>
 
 #include "src/common/errors.hpp"
 
@@ -44,7 +49,7 @@ inline bool get_opt(std::future<void>& future) {
 }
 
 template <typename Value>
-inline bool get_opt(std::future<Value>& future) {
+inline boost::optional<Value> get_opt(std::future<Value>& future) {
   return get_opt(future, std::chrono::seconds(0));
 }
 
@@ -59,12 +64,269 @@ inline void spin(std::future<void>& future, Function&& fn) {
 template <typename Future, typename Function>
 inline auto spin(Future& future, Function&& fn) {
   auto ret = get_opt(future);
-  while (!(ret = get_opt(future))) {
+  while (!ret) {
     fn();
+    ret = get_opt(future);
   }
   return *ret;
 }
 
+// Wraps a function so that its result or exception fulfills the promise.
+template <typename Function>
+inline auto makePromiseTask(
+    Function&& fn, std::shared_ptr<std::promise<void>>&& promise) {
+  return [fn = std::forward<Function>(fn),
+          promise = std::move(promise)]() mutable {
+    try {
+      fn();
+      promise->set_value();
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  };
+}
+
+template <
+    typename Function,
+    typename PromiseType,
+    typename = std::enable_if_t<!std::is_void_v<PromiseType>>>
+inline auto makePromiseTask(
+    Function&& fn, std::shared_ptr<std::promise<PromiseType>>&& promise) {
+  return [fn = std::forward<Function>(fn),
+          promise = std::move(promise)]() mutable {
+    try {
+      promise->set_value(fn());
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  };
+}
+
+template <typename Value>
+class AsyncResult;
+
+template <typename T>
+struct UnwrapAsyncResult {
+  using type = T;
+};
+
+template <typename T>
+struct UnwrapAsyncResult<AsyncResult<T>> {
+  using type = T;
+};
+
+template <typename T>
+constexpr bool kIsAsyncResult =
+    !std::is_same_v<T, typename UnwrapAsyncResult<T>::type>;
+
+// A copyable handle to a value that is fulfilled asynchronously. Unlike
+// std::future, callers can attach continuations with then() instead of
+// blocking a thread until the value is ready. Continuations run on the thread
+// that fulfills the result (or inline if it is already fulfilled).
+template <typename Value>
+class AsyncResult {
+ public:
+  using value_type = Value;
+
+  AsyncResult() : state_(std::make_shared<State>()) {}
+
+  bool isReady() const {
+    std::lock_guard lock(state_->mutex);
+    return state_->ready;
+  }
+
+  // Blocks until the result is fulfilled or the duration elapses. Returns
+  // whether the result is fulfilled.
+  template <typename Rep, typename Period>
+  bool waitFor(std::chrono::duration<Rep, Period> duration) const {
+    std::unique_lock lock(state_->mutex);
+    return state_->cv.wait_for(lock, duration, [this] { return state_->ready; });
+  }
+
+  // Blocks until the result is fulfilled and returns its value.
+  Value get() const {
+    std::unique_lock lock(state_->mutex);
+    state_->cv.wait(lock, [this] { return state_->ready; });
+    if (state_->error) {
+      std::rethrow_exception(state_->error);
+    }
+    return *state_->value;
+  }
+
+  void setValue(Value value) {
+    finish([&] { state_->value = std::move(value); });
+  }
+
+  void setException(std::exception_ptr error) {
+    finish([&] { state_->error = std::move(error); });
+  }
+
+  // Calls the function with this result once it is fulfilled.
+  template <typename Function>
+  void onReady(Function fn) const {
+    {
+      std::lock_guard lock(state_->mutex);
+      if (!state_->ready) {
+        state_->callbacks.emplace_back(std::move(fn));
+        return;
+      }
+    }
+    fn(*this);
+  }
+
+  // Returns a result fulfilled by applying the function to this result's
+  // value. Functions returning an AsyncResult are flattened.
+  template <typename Function>
+  auto then(Function fn) const {
+    using Return = decltype(fn(std::declval<const Value&>()));
+    AsyncResult<typename UnwrapAsyncResult<Return>::type> ret;
+    onReady([ret, fn = std::move(fn)](const AsyncResult& result) mutable {
+      try {
+        if constexpr (kIsAsyncResult<Return>) {
+          fn(result.get()).forward(ret);
+        } else {
+          ret.setValue(fn(result.get()));
+        }
+      } catch (...) {
+        ret.setException(std::current_exception());
+      }
+    });
+    return ret;
+  }
+
+  // Fulfills the other result with this result's value or exception.
+  void forward(AsyncResult other) const {
+    onReady([other](const AsyncResult& result) mutable {
+      try {
+        other.setValue(result.get());
+      } catch (...) {
+        other.setException(std::current_exception());
+      }
+    });
+  }
+
+  // Returns a std::future fulfilled along with this result.
+  std::future<Value> future() const {
+    auto promise = std::make_shared<std::promise<Value>>();
+    auto ret = promise->get_future();
+    onReady([promise](const AsyncResult& result) {
+      try {
+        promise->set_value(result.get());
+      } catch (...) {
+        promise->set_exception(std::current_exception());
+      }
+    });
+    return ret;
+  }
+
+ private:
+  using Callback = std::function<void(const AsyncResult&)>;
+
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready = false;
+    boost::optional<Value> value;
+    std::exception_ptr error;
+    std::vector<Callback> callbacks;
+  };
+
+  template <typename Function>
+  void finish(Function&& fn) {
+    std::vector<Callback> callbacks;
+    {
+      std::lock_guard lock(state_->mutex);
+      ENFORCE(!state_->ready, "AsyncResult fulfilled twice.");
+      fn();
+      state_->ready = true;
+      callbacks.swap(state_->callbacks);
+    }
+    state_->cv.notify_all();
+    for (auto& callback : callbacks) {
+      callback(*this);
+    }
+  }
+
+  std::shared_ptr<State> state_;
+};
+
+template <typename Value>
+inline auto makeReadyAsyncResult(Value value) {
+  AsyncResult<std::decay_t<Value>> ret;
+  ret.setValue(std::move(value));
+  return ret;
+}
+
+// Wraps a plain value in a fulfilled AsyncResult or passes one through.
+template <typename Value>
+inline auto toAsyncResult(Value value) {
+  if constexpr (kIsAsyncResult<Value>) {
+    return value;
+  } else {
+    return makeReadyAsyncResult(std::move(value));
+  }
+}
+
+// Returns a result fulfilled with all of the given results' values once they
+// are ready. Fails with the first exception raised by any of the results.
+inline auto whenAll() {
+  return makeReadyAsyncResult(std::tuple<>());
+}
+
+template <typename Value, typename... Values>
+inline auto whenAll(AsyncResult<Value> first, AsyncResult<Values>... rest) {
+  return first.then([rest...](const Value& value) {
+    return whenAll(rest...).then([value](const std::tuple<Values...>& values) {
+      return std::tuple_cat(std::make_tuple(value), values);
+    });
+  });
+}
+
+template <typename Value>
+inline auto whenAll(std::vector<AsyncResult<Value>> results) {
+  struct State {
+    std::mutex mutex;
+    size_t remaining;
+    bool failed = false;
+    std::vector<boost::optional<Value>> values;
+  };
+  AsyncResult<std::vector<Value>> ret;
+  if (results.empty()) {
+    ret.setValue(std::vector<Value>());
+    return ret;
+  }
+  auto state = std::make_shared<State>();
+  state->remaining = results.size();
+  state->values.resize(results.size());
+  for (size_t i = 0; i < results.size(); i += 1) {
+    auto on_ready = [ret, state, i](const AsyncResult<Value>& result) mutable {
+      std::unique_lock lock(state->mutex);
+      if (state->failed) {
+        return;
+      }
+      try {
+        state->values[i] = result.get();
+      } catch (...) {
+        state->failed = true;
+        lock.unlock();
+        ret.setException(std::current_exception());
+        return;
+      }
+      if (--state->remaining == 0) {
+        std::vector<Value> values;
+        values.reserve(state->values.size());
+        for (auto& value : state->values) {
+          values.push_back(std::move(*value));
+        }
+        lock.unlock();
+        ret.setValue(std::move(values));
+      }
+    };
+    results[i].onReady(std::move(on_ready));
+  }
+  return ret;
+}
+
 template <typename Value>
 class MPMCQueue {
  public:
@@ -94,6 +356,17 @@ class MPMCQueue {
     cv_.notify_all();
   }
 
+  // Pops a value without blocking if one is available.
+  boost::optional<Value> tryPop() {
+    std::lock_guard lock(mutex_);
+    boost::optional<Value> ret;
+    if (!queue_.empty()) {
+      ret = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    return ret;
+  }
+
   void push(Value value) {
     {
       std::lock_guard lock(mutex_);
@@ -125,9 +398,190 @@ class MPMCQueue {
   bool closed_;
 };
 
+// A lock-free bounded MPMC queue backed by a ring buffer where each slot
+// carries a sequence number (see Dmitry Vyukov's bounded MPMC queue). Pushes
+// only block while the queue is full and pops only block when it is empty.
+template <typename Value>
+class BoundedMPMCQueue {
+ public:
+  BoundedMPMCQueue(size_t capacity = 1 << 12)
+      : mask_(capacity - 1),
+        cells_(std::make_unique<Cell[]>(capacity)),
+        enqueue_pos_(0),
+        dequeue_pos_(0),
+        sleepers_(0),
+        full_sleepers_(0),
+        pushers_(0),
+        closed_(false) {
+    ENFORCE(capacity >= 2, "Capacity must be at least 2.");
+    ENFORCE(!(capacity & (capacity - 1)), "Capacity must be power of 2.");
+    for (size_t i = 0; i < capacity; i += 1) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool isOpen() {
+    return !closed_;
+  }
+
+  bool isEmpty() {
+    return size() == 0;
+  }
+
+  size_t size() {
+    auto head = dequeue_pos_.load();
+    auto tail = enqueue_pos_.load();
+    return tail > head ? tail - head : 0;
+  }
+
+  void close() {
+    {
+      std::lock_guard lock(mutex_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+    full_cv_.notify_all();
+
+    // Wait for pushes that started before the queue closed so that none of
+    // their values are left behind after draining.
+    while (pushers_.load()) {
+      std::this_thread::yield();
+    }
+    while (tryPop()) {
+    }
+  }
+
+  void push(Value value) {
+    // Pairs with the closed check in close() so that either the push sees the
+    // queue closed or close() waits for the push to finish.
+    pushers_.fetch_add(1);
+    bool pushed = false;
+    while (!closed_ && !(pushed = tryPush(value))) {
+      // Block until a consumer frees a slot. The wait times out periodically
+      // in case a consumer's notification races with this producer parking.
+      std::unique_lock lock(mutex_);
+      full_sleepers_.fetch_add(1);
+      full_cv_.wait_for(lock, kFullWait, [this] {
+        return closed_ || size() <= mask_;
+      });
+      full_sleepers_.fetch_sub(1);
+    }
+    pushers_.fetch_sub(1);
+    ENFORCE(pushed, "Pushed to a closed queue.");
+    notify(sleepers_, cv_);
+  }
+
+  boost::optional<Value> pop() {
+    constexpr int kSpinCount = 16;
+    boost::optional<Value> ret;
+    while (!closed_) {
+      for (int i = 0; i < kSpinCount; i += 1) {
+        if ((ret = tryPop())) {
+          return ret;
+        }
+        std::this_thread::yield();
+      }
+
+      // Only block on the condition variable once the queue looks empty.
+      std::unique_lock lock(mutex_);
+      sleepers_.fetch_add(1);
+      cv_.wait(lock, [this] { return closed_ || !isEmpty(); });
+      sleepers_.fetch_sub(1);
+    }
+    return ret;
+  }
+
+  // Pushes the value unless the queue is full. The value is only moved from if
+  // the push succeeds.
+  bool tryPush(Value& value) {
+    Cell* cell;
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      auto seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Pops a value without blocking if one is available.
+  boost::optional<Value> tryPop() {
+    boost::optional<Value> ret;
+    Cell* cell;
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      auto seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return ret;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    ret = std::move(cell->value);
+    cell->value = boost::none;
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    notify(full_sleepers_, full_cv_);
+    return ret;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    boost::optional<Value> value;
+  };
+
+  // Wakes a thread parked on the condition variable if there are any.
+  void notify(std::atomic<int>& sleepers, std::condition_variable& cv) {
+    // Pairs with the sleepers increment in pop() and push() so that either
+    // this thread sees a sleeper or the sleeper sees the queue's new state.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load()) {
+      {
+        std::lock_guard lock(mutex_);
+      }
+      cv.notify_one();
+    }
+  }
+
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr auto kFullWait = std::chrono::milliseconds(1);
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_;
+  alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_;
+  alignas(kCacheLineSize) std::atomic<int> sleepers_;
+  std::atomic<int> full_sleepers_;
+  std::atomic<int> pushers_;
+  std::atomic<bool> closed_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable full_cv_;
+};
+
 class QueueExecutor {
  public:
-  QueueExecutor(size_t thread_count) : finished_workers_(0) {
+  QueueExecutor(size_t thread_count)
+      : task_queue_(kQueueCapacity), finished_workers_(0) {
     ENFORCE(thread_count > 0);
     for (int i = 0; i < thread_count; i += 1) {
       workers_.emplace_back([&] {
@@ -163,43 +617,285 @@ class QueueExecutor {
     ENFORCE(task_queue_.isOpen());
     auto promise = std::make_shared<std::promise<decltype(fn())>>();
     auto ret = promise->get_future();
-    task_queue_.push(makeTask(std::forward<Function>(fn), std::move(promise)));
+    task_queue_.push(
+        makePromiseTask(std::forward<Function>(fn), std::move(promise)));
     return ret;
   }
 
  private:
+  static constexpr size_t kQueueCapacity = 1 << 16;
+
+  std::vector<std::thread> workers_;
+  BoundedMPMCQueue<std::function<void()>> task_queue_;
+  std::atomic<int> finished_workers_;
+};
+
+// Returns the default number of worker threads for the task executors. We
+// keep a floor on the count since some tasks block on the OpenGL thread.
+inline size_t defaultThreadCount() {
+  constexpr size_t kMinThreadCount = 4;
+  return std::max<size_t>(kMinThreadCount, std::thread::hardware_concurrency());
+}
+
+// An executor where each worker owns a task deque. Workers push and pop tasks
+// at the back of their own deque and steal from the front of other deques when
+// idle. Tasks scheduled from a worker thread are pushed to its own deque so
+// that fine-grained nested tasks stay local and cheap to schedule.
+class WorkStealingExecutor {
+ public:
+  WorkStealingExecutor(size_t thread_count = defaultThreadCount())
+      : closed_(false),
+        pending_(0),
+        sleepers_(0),
+        next_queue_(0),
+        finished_workers_(0) {
+    ENFORCE(thread_count > 0);
+    for (size_t i = 0; i < thread_count; i += 1) {
+      queues_.push_back(std::make_unique<TaskDeque>());
+    }
+    for (size_t i = 0; i < thread_count; i += 1) {
+      workers_.emplace_back([this, i] {
+        current_executor_ = this;
+        current_index_ = i;
+        while (true) {
+          if (auto task = popTask(i)) {
+            runTask(*task);
+            continue;
+          }
+          std::unique_lock lock(sleep_mutex_);
+          sleepers_.fetch_add(1);
+          sleep_cv_.wait(lock, [this] { return closed_ || pending_ > 0; });
+          sleepers_.fetch_sub(1);
+          if (closed_) {
+            break;
+          }
+        }
+        finished_workers_ += 1;
+      });
+    }
+  }
+
+  ~WorkStealingExecutor() {
+    close();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  auto queueSize() {
+    return static_cast<size_t>(std::max<int64_t>(0, pending_));
+  }
+
+  bool isDone() {
+    return workers_.size() == finished_workers_;
+  }
+
+  // Discards any queued tasks and stops the workers.
+  void close() {
+    {
+      std::lock_guard lock(sleep_mutex_);
+      closed_ = true;
+    }
+    for (auto& queue : queues_) {
+      std::lock_guard lock(queue->mutex);
+      pending_ -= queue->tasks.size();
+      queue->tasks.clear();
+    }
+    sleep_cv_.notify_all();
+  }
+
+  bool isOpen() {
+    return !closed_;
+  }
+
   template <typename Function>
-  auto makeTask(Function&& fn, std::shared_ptr<std::promise<void>>&& promise) {
-    return [fn = std::forward<Function>(fn),
-            promise = std::move(promise)]() mutable {
-      try {
-        fn();
-        promise->set_value();
-      } catch (...) {
-        promise->set_exception(std::current_exception());
+  auto schedule(Function&& fn) {
+    ENFORCE(!closed_);
+    auto promise = std::make_shared<std::promise<decltype(fn())>>();
+    auto ret = promise->get_future();
+    pushTask(makePromiseTask(std::forward<Function>(fn), std::move(promise)));
+    return ret;
+  }
+
+  // Waits on the given future. Worker threads run the tasks scheduled by their
+  // current task while they wait so that tasks waiting on their own nested
+  // tasks can't deadlock when every worker is waiting. Unrelated tasks are
+  // never run on the waiting stack since they could grow it without bound or
+  // re-enter locks held further down it.
+  template <typename Value>
+  auto wait(std::future<Value>& future) {
+    if (current_executor_ != this) {
+      return future.get();
+    }
+    Backoff backoff;
+    while (future.wait_for(std::chrono::seconds(0)) !=
+           std::future_status::ready) {
+      if (runPendingTask()) {
+        backoff.reset();
+      } else {
+        future.wait_for(backoff.next());
       }
-    };
+    }
+    return future.get();
   }
 
-  template <
-      typename Function,
-      typename PromiseType,
-      typename = std::enable_if_t<!std::is_void_v<PromiseType>>>
-  auto makeTask(
-      Function&& fn, std::shared_ptr<std::promise<PromiseType>>&& promise) {
-    return [fn = std::forward<Function>(fn),
-            promise = std::move(promise)]() mutable {
-      try {
-        promise->set_value(fn());
-      } catch (...) {
-        promise->set_exception(std::current_exception());
+  // Waits on the given result. Like above, worker threads run the tasks
+  // scheduled by their current task while they wait.
+  template <typename Value>
+  auto wait(const AsyncResult<Value>& result) {
+    if (current_executor_ == this) {
+      Backoff backoff;
+      while (!result.isReady()) {
+        if (runPendingTask()) {
+          backoff.reset();
+        } else {
+          result.waitFor(backoff.next());
+        }
       }
-    };
+    }
+    return result.get();
   }
 
+ private:
+  using Task = std::function<void()>;
+
+  // Tasks are numbered in the order they're pushed to each deque so that a
+  // waiting worker can tell which tasks were scheduled by its current task.
+  // Tasks pushed from other threads are never considered nested.
+  struct QueuedTask {
+    uint64_t sequence;
+    bool nested;
+    Task fn;
+  };
+
+  struct TaskDeque {
+    std::mutex mutex;
+    std::deque<QueuedTask> tasks;
+    uint64_t next_sequence = 0;
+  };
+
+  // Parks a waiting thread for exponentially longer durations while no tasks
+  // are available so that it stops burning CPU but still picks up new tasks.
+  class Backoff {
+   public:
+    void reset() {
+      wait_ = kMinWait;
+    }
+
+    std::chrono::microseconds next() {
+      auto ret = wait_;
+      wait_ = std::min(2 * wait_, kMaxWait);
+      return ret;
+    }
+
+   private:
+    static constexpr auto kMinWait = std::chrono::microseconds(10);
+    static constexpr auto kMaxWait = std::chrono::microseconds(1000);
+
+    std::chrono::microseconds wait_ = kMinWait;
+  };
+
+  // Runs the task on the calling worker, recording where the tasks it
+  // schedules start in the worker's deque (see runPendingTask).
+  void runTask(Task& task) {
+    auto mark = current_mark_;
+    {
+      auto& queue = *queues_.at(current_index_);
+      std::lock_guard lock(queue.mutex);
+      current_mark_ = queue.next_sequence;
+    }
+    task();
+    current_mark_ = mark;
+  }
+
+  // Runs the most recently pushed task of the calling worker's deque if it
+  // was scheduled by the worker's current task. Returns false if no such task
+  // was available to run.
+  bool runPendingTask() {
+    boost::optional<Task> task;
+    {
+      auto& queue = *queues_.at(current_index_);
+      std::lock_guard lock(queue.mutex);
+      if (!queue.tasks.empty() && queue.tasks.back().nested &&
+          queue.tasks.back().sequence >= current_mark_) {
+        task = std::move(queue.tasks.back().fn);
+        queue.tasks.pop_back();
+        pending_ -= 1;
+      }
+    }
+    if (task) {
+      runTask(*task);
+    }
+    return task.has_value();
+  }
+
+  void pushTask(Task task) {
+    auto nested = current_executor_ == this;
+    auto index = nested ? current_index_ : next_queue_++ % queues_.size();
+    {
+      auto& queue = *queues_.at(index);
+      std::lock_guard lock(queue.mutex);
+      queue.tasks.push_back(
+          QueuedTask{queue.next_sequence++, nested, std::move(task)});
+      pending_.fetch_add(1);
+    }
+
+    // Only wake a worker if one is parked. The pending count and sleeper count
+    // are both sequentially consistent so either the producer sees a sleeper
+    // or the sleeper sees the pending task before it parks.
+    if (sleepers_.load()) {
+      {
+        // Acquire the sleep mutex so that a worker can't miss the notification
+        // between checking for pending tasks and going to sleep.
+        std::lock_guard lock(sleep_mutex_);
+      }
+      sleep_cv_.notify_one();
+    }
+  }
+
+  boost::optional<Task> popTask(size_t index) {
+    boost::optional<Task> ret;
+
+    // Pop the most recently pushed task from this worker's own deque.
+    {
+      auto& queue = *queues_.at(index);
+      std::lock_guard lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        ret = std::move(queue.tasks.back().fn);
+        queue.tasks.pop_back();
+        pending_ -= 1;
+        return ret;
+      }
+    }
+
+    // Otherwise steal the oldest task from another worker's deque.
+    for (size_t i = 1; i < queues_.size(); i += 1) {
+      auto& queue = *queues_.at((index + i) % queues_.size());
+      std::lock_guard lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        ret = std::move(queue.tasks.front().fn);
+        queue.tasks.pop_front();
+        pending_ -= 1;
+        return ret;
+      }
+    }
+
+    return ret;
+  }
+
+  inline static thread_local WorkStealingExecutor* current_executor_ = nullptr;
+  inline static thread_local size_t current_index_ = 0;
+  inline static thread_local uint64_t current_mark_ = 0;
+
+  std::vector<std::unique_ptr<TaskDeque>> queues_;
   std::vector<std::thread> workers_;
-  MPMCQueue<std::function<void()>> task_queue_;
-  std::atomic<int> finished_workers_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<bool> closed_;
+  std::atomic<int64_t> pending_;
+  std::atomic<int> sleepers_;
+  std::atomic<size_t> next_queue_;
+  std::atomic<size_t> finished_workers_;
 };
 
 }  // namespace tequila
\ No newline at end of file
@@ -29,11 +29,11 @@ Framebuffer::Framebuffer(
   glGenRenderbuffers(1, &depthbuffer_);
 
   // Bind the buffers.
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glState().bindFramebuffer(framebuffer_);
   glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer_);
   Finally finally([&] {
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState().bindFramebuffer(0);
   });
 
   // Initialize the renderbuffers.
@@ -78,6 +78,7 @@ Framebuffer::~Framebuffer() {
     glDeleteRenderbuffers(1, &depthbuffer_);
   }
   if (framebuffer_) {
+    glState().deleteFramebuffer(framebuffer_);
     glDeleteFramebuffers(1, &framebuffer_);
   }
 }
@@ -107,11 +108,11 @@ MultisampleFramebuffer::MultisampleFramebuffer(
   glGenRenderbuffers(1, &depthbuffer_);
 
   // Bind the buffers.
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glState().bindFramebuffer(framebuffer_);
   glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer_);
   Finally finally([&] {
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState().bindFramebuffer(0);
   });
 
   // Initialize the renderbuffers.
@@ -157,6 +158,7 @@ MultisampleFramebuffer::~MultisampleFramebuffer() {
     glDeleteRenderbuffers(1, &depthbuffer_);
   }
   if (framebuffer_) {
+    glState().deleteFramebuffer(framebuffer_);
     glDeleteFramebuffers(1, &framebuffer_);
   }
 }
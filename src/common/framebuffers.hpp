@@ -1,5 +1,6 @@
 #pragma once
 
+#include "src/common/glstate.hpp"
 #include "src/common/opengl.hpp"
 #include "src/common/textures.hpp"
 
@@ -64,10 +65,10 @@ template <typename FBO>
 class FramebufferBinding {
  public:
   FramebufferBinding(FBO& fbo) : fbo_(fbo) {
-    gl::glBindFramebuffer(gl::GL_FRAMEBUFFER, fbo_.framebuffer_);
+    glState().bindFramebuffer(fbo_.framebuffer_);
   }
   ~FramebufferBinding() noexcept {
-    gl::glBindFramebuffer(gl::GL_FRAMEBUFFER, 0);
+    glState().bindFramebuffer(0);
   }
 
  private:
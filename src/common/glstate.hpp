@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "src/common/opengl.hpp"
+#include "src/common/stats.hpp"
+
+namespace tequila {
+
+// Tracks the OpenGL state bound through it to skip calls that would not change
+// anything (e.g. binding the program or texture which is already bound). State
+// set without going through the tracker is not seen by it so all binds of the
+// tracked state must go through glState(). State starts out unknown so that the
+// first call for each piece of state is always issued.
+class GLState {
+ public:
+  GLState() {
+    program_ = vertex_array_ = framebuffer_ = active_unit_ = kUnknown;
+    depth_test_ = blend_ = blend_src_ = blend_dst_ = kUnknown;
+    for (auto& unit : textures_) {
+      unit.fill(kUnknown);
+    }
+  }
+
+  GLState(const GLState&) = delete;
+  GLState& operator=(const GLState&) = delete;
+
+  void useProgram(gl::GLuint program) {
+    if (update(program_, program)) {
+      gl::glUseProgram(program);
+    }
+  }
+
+  void bindVertexArray(gl::GLuint vertex_array) {
+    if (update(vertex_array_, vertex_array)) {
+      gl::glBindVertexArray(vertex_array);
+    }
+  }
+
+  void bindFramebuffer(gl::GLuint framebuffer) {
+    if (update(framebuffer_, framebuffer)) {
+      gl::glBindFramebuffer(gl::GL_FRAMEBUFFER, framebuffer);
+    }
+  }
+
+  // Binds a texture to the given texture unit.
+  void bindTexture(int unit, gl::GLenum target, gl::GLuint texture) {
+    auto index = targetIndex(target);
+    if (unit >= kMaxUnits || index < 0) {
+      activeTexture(unit);
+      issued_ += 1;
+      gl::glBindTexture(target, texture);
+    } else if (textures_[unit][index] != texture) {
+      activeTexture(unit);
+      textures_[unit][index] = texture;
+      issued_ += 1;
+      gl::glBindTexture(target, texture);
+    } else {
+      avoided_ += 1;
+    }
+  }
+
+  void setDepthTest(bool enabled) {
+    setCapability(depth_test_, gl::GL_DEPTH_TEST, enabled);
+  }
+
+  void setBlend(bool enabled) {
+    setCapability(blend_, gl::GL_BLEND, enabled);
+  }
+
+  void blendFunc(gl::GLenum src, gl::GLenum dst) {
+    auto src_value = static_cast<int64_t>(src);
+    auto dst_value = static_cast<int64_t>(dst);
+    if (blend_src_ != src_value || blend_dst_ != dst_value) {
+      blend_src_ = src_value;
+      blend_dst_ = dst_value;
+      issued_ += 1;
+      gl::glBlendFunc(src, dst);
+    } else {
+      avoided_ += 1;
+    }
+  }
+
+  // Deleting an object unbinds it in the current context so these must be
+  // called when objects are deleted in case their names are reused. Programs
+  // are not needed here since they stay in use until replaced.
+  void deleteVertexArray(gl::GLuint vertex_array) {
+    forget(vertex_array_, vertex_array);
+  }
+
+  void deleteFramebuffer(gl::GLuint framebuffer) {
+    forget(framebuffer_, framebuffer);
+  }
+
+  void deleteTexture(gl::GLuint texture) {
+    for (auto& unit : textures_) {
+      for (auto& bound : unit) {
+        forget(bound, texture);
+      }
+    }
+  }
+
+  // Publishes the number of calls issued and avoided since the last report.
+  void reportStats(Stats& stats) {
+    stats.set("gl_issued_calls_count", issued_);
+    stats.set("gl_avoided_calls_count", avoided_);
+    issued_ = avoided_ = 0;
+  }
+
+ private:
+  static constexpr int64_t kUnknown = -1;
+  static constexpr int kMaxUnits = 16;
+
+  // Returns the index of texture targets that are tracked or -1 otherwise.
+  static int targetIndex(gl::GLenum target) {
+    switch (target) {
+      case gl::GL_TEXTURE_2D:
+        return 0;
+      case gl::GL_TEXTURE_2D_MULTISAMPLE:
+        return 1;
+      case gl::GL_TEXTURE_2D_ARRAY:
+        return 2;
+      case gl::GL_TEXTURE_CUBE_MAP:
+        return 3;
+      default:
+        return -1;
+    }
+  }
+
+  // Records a new value and returns true if the call must be issued.
+  bool update(int64_t& current, int64_t value) {
+    if (current == value) {
+      avoided_ += 1;
+      return false;
+    }
+    current = value;
+    issued_ += 1;
+    return true;
+  }
+
+  static void forget(int64_t& current, gl::GLuint name) {
+    if (current == name) {
+      current = 0;
+    }
+  }
+
+  void activeTexture(int unit) {
+    if (update(active_unit_, unit)) {
+      gl::glActiveTexture(gl::GL_TEXTURE0 + unit);
+    }
+  }
+
+  void setCapability(int64_t& current, gl::GLenum capability, bool enabled) {
+    if (update(current, enabled)) {
+      if (enabled) {
+        gl::glEnable(capability);
+      } else {
+        gl::glDisable(capability);
+      }
+    }
+  }
+
+  int64_t program_;
+  int64_t vertex_array_;
+  int64_t framebuffer_;
+  int64_t active_unit_;
+  int64_t depth_test_;
+  int64_t blend_;
+  int64_t blend_src_;
+  int64_t blend_dst_;
+  std::array<std::array<int64_t, 4>, kMaxUnits> textures_;
+  size_t issued_ = 0;
+  size_t avoided_ = 0;
+};
+
+// Returns the state tracker of the OpenGL context current on this thread.
+inline GLState& glState() {
+  thread_local GLState state;
+  return state;
+}
+
+}  // namespace tequila
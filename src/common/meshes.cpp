@@ -3,6 +3,10 @@
 #include <Eigen/Dense>
 #include <glm/glm.hpp>
 
+#include <vector>
+
+#include "src/common/errors.hpp"
+#include "src/common/glstate.hpp"
 #include "src/common/opengl.hpp"
 #include "src/common/shaders.hpp"
 
@@ -13,21 +17,24 @@ using namespace gl;
 Mesh::Mesh(
     Eigen::MatrixXf vertices,
     std::vector<VertexAttribute> attributes,
-    glm::mat4x4 transform)
-    : vertices_(std::move(vertices)),
+    glm::mat4x4 transform,
+    bool retain_vertices)
+    : vao_(0),
+      vbo_size_(sizeof(float) * vertices.size()),
+      rows_(vertices.rows()),
+      cols_(vertices.cols()),
       attributes_(std::move(attributes)),
       transform_(std::move(transform)) {
-  glGenVertexArrays(1, &vao_);
-
   // Create and populate the mesh's vertex buffer.
   glGenBuffers(1, &vbo_);
   glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glBufferData(
-      GL_ARRAY_BUFFER,
-      sizeof(float) * vertices_.size(),
-      vertices_.data(),
-      GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, vbo_size_, vertices.data(), GL_STATIC_DRAW);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // The vertices are released with the argument unless retained.
+  if (retain_vertices) {
+    vertices_ = std::move(vertices);
+  }
 }
 
 Mesh::~Mesh() {
@@ -35,17 +42,22 @@ Mesh::~Mesh() {
     glDeleteBuffers(1, &vbo_);
   }
   if (vao_) {
+    glState().deleteVertexArray(vao_);
     glDeleteVertexArrays(1, &vao_);
   }
 }
 
-Mesh::Mesh(Mesh&& other) : vao_(0), vbo_(0) {
+Mesh::Mesh(Mesh&& other)
+    : vao_(0), vbo_(0), vbo_size_(0), rows_(0), cols_(0) {
   *this = std::move(other);
 }
 
 Mesh& Mesh::operator=(Mesh&& other) {
   std::swap(vao_, other.vao_);
   std::swap(vbo_, other.vbo_);
+  std::swap(vbo_size_, other.vbo_size_);
+  std::swap(rows_, other.rows_);
+  std::swap(cols_, other.cols_);
   vertices_ = std::move(other.vertices_);
   attributes_ = std::move(other.attributes_);
   transform_ = std::move(other.transform_);
@@ -60,43 +72,68 @@ const glm::mat4x4& Mesh::transform() const {
   return transform_;
 }
 
-void Mesh::draw(ShaderProgram& shader) const {
-  glBindVertexArray(vao_);
+const Eigen::MatrixXf& Mesh::vertices() const {
+  return vertices_;
+}
+
+size_t Mesh::cpuBytes() const {
+  size_t ret = sizeof(*this) + sizeof(float) * vertices_.size();
+  for (const auto& attribute : attributes_) {
+    ret += sizeof(attribute) + attribute.name.capacity();
+  }
+  return ret;
+}
+
+size_t Mesh::gpuBytes() const {
+  return vbo_size_;
+}
+
+void Mesh::draw() const {
+  bind();
+  glDrawArrays(GL_TRIANGLES, 0, cols_);
+}
+
+void Mesh::drawRanges(
+    const std::vector<GLint>& firsts,
+    const std::vector<GLsizei>& counts) const {
+  ENFORCE(firsts.size() == counts.size());
+  if (firsts.empty()) {
+    return;
+  }
+  bind();
+  glMultiDrawArrays(GL_TRIANGLES, firsts.data(), counts.data(), firsts.size());
+}
+
+void Mesh::bind() const {
+  if (vao_) {
+    glState().bindVertexArray(vao_);
+    return;
+  }
+  glGenVertexArrays(1, &vao_);
+  glState().bindVertexArray(vao_);
   glBindBuffer(GL_ARRAY_BUFFER, vbo_);
 
-  // Bind all of the vertex attributes to the shader.
-  auto stride = vertices_.rows() * sizeof(float);
+  // Bind all of the vertex attributes to their standard locations. Shaders
+  // ignore the attributes they don't declare.
+  auto stride = rows_ * sizeof(float);
   size_t offset = 0;
   for (const auto& attribute : attributes_) {
-    if (shader.hasAttribute(attribute.name)) {
-      auto location = shader.attribute(attribute.name);
-      glEnableVertexAttribArray(location);
-      glVertexAttribPointer(
-          location,
-          attribute.dimension,
-          GL_FLOAT,
-          GL_FALSE,
-          stride,
-          static_cast<float*>(nullptr) + offset);
-      offset += attribute.dimension;
-    }
-  }
-
-  // Draw the vertex data.
-  glDrawArrays(GL_TRIANGLES, 0, vertices_.cols());
-
-  // Clean up.
-  for (const auto& attribute : attributes_) {
-    if (shader.hasAttribute(attribute.name)) {
-      auto location = shader.attribute(attribute.name);
-      glDisableVertexAttribArray(location);
-    }
+    auto location = vertexAttributeLocation(attribute.name);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(
+        location,
+        attribute.dimension,
+        GL_FLOAT,
+        GL_FALSE,
+        stride,
+        static_cast<float*>(nullptr) + offset);
+    offset += attribute.dimension;
   }
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
 }
 
-MeshBuilder::MeshBuilder() : transform_(glm::mat4(1.0f)) {}
+MeshBuilder::MeshBuilder()
+    : transform_(glm::mat4(1.0f)), retain_vertices_(false) {}
 
 MeshBuilder& MeshBuilder::setPositions(VertexArray3f data) {
   positions_.swap(data);
@@ -128,6 +165,11 @@ MeshBuilder& MeshBuilder::setTransform(glm::mat4x4 transform) {
   return *this;
 }
 
+MeshBuilder& MeshBuilder::setRetainVertices(bool retain_vertices) {
+  retain_vertices_ = retain_vertices;
+  return *this;
+}
+
 Mesh MeshBuilder::build() {
   // Compute the attribute metadata.
   std::vector<VertexAttribute> attributes;
@@ -182,7 +224,11 @@ Mesh MeshBuilder::build() {
     mesh_data.block(offset, 0, tex_coords_.rows(), cols) = tex_coords_;
     offset += tex_coords_.rows();
   }
-  return Mesh(std::move(mesh_data), std::move(attributes), transform_);
+  return Mesh(
+      std::move(mesh_data),
+      std::move(attributes),
+      transform_,
+      retain_vertices_);
 }
 
 }  // namespace tequila
@@ -3,6 +3,8 @@
 #include <Eigen/Dense>
 #include <glm/glm.hpp>
 
+#include <vector>
+
 #include "src/common/opengl.hpp"
 #include "src/common/shaders.hpp"
 
@@ -15,12 +17,15 @@ struct VertexAttribute {
       : name(std::move(name)), dimension(dimension) {}
 };
 
+// A vertex buffer uploaded to the GPU. Only the vertex layout is kept on the
+// CPU unless the vertices are explicitly retained (e.g. for readback).
 class Mesh {
  public:
   Mesh(
       Eigen::MatrixXf vertices,
       std::vector<VertexAttribute> attributes,
-      glm::mat4x4 transform);
+      glm::mat4x4 transform,
+      bool retain_vertices = false);
   ~Mesh();
 
   // Add explicit move constructor and assignment operator
@@ -33,11 +38,35 @@ class Mesh {
 
   glm::mat4x4& transform();
   const glm::mat4x4& transform() const;
-  void draw(ShaderProgram& shader) const;
+
+  // Draws the mesh with the running shader. Vertex attributes are bound to
+  // their standard locations (see kVertexAttributeNames).
+  void draw() const;
+
+  // Draws ranges of vertices (e.g. sub-meshes packed into this mesh's vertex
+  // buffer) with a single multi-draw call.
+  void drawRanges(
+      const std::vector<gl::GLint>& firsts,
+      const std::vector<gl::GLsizei>& counts) const;
+
+  // Returns the retained vertices (or an empty matrix if not retained).
+  const Eigen::MatrixXf& vertices() const;
+
+  // Returns the bytes of host and device memory owned by this mesh.
+  size_t cpuBytes() const;
+  size_t gpuBytes() const;
 
  private:
-  gl::GLuint vao_;
+  void bind() const;
+
+  // The vertex array is created and configured on first draw since vertex
+  // arrays can't be shared between contexts and meshes may be uploaded in a
+  // shared context.
+  mutable gl::GLuint vao_;
   gl::GLuint vbo_;
+  size_t vbo_size_;
+  Eigen::Index rows_;
+  Eigen::Index cols_;
   Eigen::MatrixXf vertices_;
   std::vector<VertexAttribute> attributes_;
   glm::mat4x4 transform_;
@@ -56,6 +85,7 @@ class MeshBuilder {
   MeshBuilder& setColors(VertexArrayf data);
   MeshBuilder& setTexCoords(VertexArray2f data);
   MeshBuilder& setTransform(glm::mat4x4 transform);
+  MeshBuilder& setRetainVertices(bool retain_vertices);
   Mesh build();
 
  private:
@@ -65,6 +95,7 @@ class MeshBuilder {
   VertexArrayf colors_;
   VertexArray2f tex_coords_;
   glm::mat4x4 transform_;
+  bool retain_vertices_;
 };
 
 }  // namespace tequila
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "src/common/camera.hpp"
+#include "src/common/errors.hpp"
+
+namespace tequila {
+
+// A low resolution software depth buffer for occlusion culling on the CPU.
+// Occluders are boxes known to be entirely solid. Pixels whose centers they
+// cover take the farthest depth of the occluder over the pixel, which leaves
+// no gaps between adjacent faces. Boxes are tested against the pixels they
+// touch plus a one pixel border to make up for partially covered pixels. A
+// pyramid of max depths lets a box be tested against a few texels instead of
+// every pixel it covers (i.e. hierarchical-Z culling).
+class OcclusionBuffer {
+ public:
+  OcclusionBuffer(int width, int height) : width_(width), height_(height) {
+    ENFORCE(width >= kLanes && (width & (width - 1)) == 0);
+    ENFORCE(height > 0 && (height & (height - 1)) == 0);
+  }
+
+  // Clears the buffer to render occluders as seen from the camera.
+  void clear(const Camera& camera) {
+    position_ = camera.position;
+    view_proj_ = camera.projectionMatrix() * camera.viewMatrix();
+    levels_.resize(1);
+    levels_[0].assign(width_ * height_, 1.0f);
+  }
+
+  // Rasterizes the faces of a solid box that face the camera.
+  void addOccluder(const glm::vec3& lo, const glm::vec3& hi) {
+    for (int axis = 0; axis < 3; axis += 1) {
+      float w;
+      if (position_[axis] < lo[axis]) {
+        w = lo[axis];
+      } else if (position_[axis] > hi[axis]) {
+        w = hi[axis];
+      } else {
+        continue;
+      }
+      int u = (axis + 1) % 3, v = (axis + 2) % 3;
+      std::array<glm::vec3, 4> corners;
+      for (int i = 0; i < 4; i += 1) {
+        corners[i][axis] = w;
+        corners[i][u] = (i == 1 || i == 2) ? hi[u] : lo[u];
+        corners[i][v] = (i >= 2) ? hi[v] : lo[v];
+      }
+      rasterizeQuad(corners);
+    }
+  }
+
+  // Builds the max depth pyramid once all occluders are added.
+  void finish() {
+    ENFORCE(levels_.size() == 1);
+    for (int w = width_ / 2, h = height_ / 2; w > 0 && h > 0; w /= 2, h /= 2) {
+      const auto& prev = levels_.back();
+      std::vector<float> level(w * h);
+      for (int y = 0; y < h; y += 1) {
+        const float* row0 = &prev[2 * y * 2 * w];
+        const float* row1 = row0 + 2 * w;
+        for (int x = 0; x < w; x += 1) {
+          level[y * w + x] = std::max(
+              std::max(row0[2 * x], row0[2 * x + 1]),
+              std::max(row1[2 * x], row1[2 * x + 1]));
+        }
+      }
+      levels_.push_back(std::move(level));
+    }
+  }
+
+  // Returns true if the box is entirely hidden behind the occluders.
+  bool isOccluded(const glm::vec3& lo, const glm::vec3& hi) const {
+    ENFORCE(levels_.size());
+    auto inf = std::numeric_limits<float>::infinity();
+    float x0 = inf, y0 = inf, x1 = -inf, y1 = -inf, near = inf;
+    for (int i = 0; i < 8; i += 1) {
+      auto p = view_proj_ *
+          glm::vec4(
+                   i & 1 ? hi.x : lo.x,
+                   i & 2 ? hi.y : lo.y,
+                   i & 4 ? hi.z : lo.z,
+                   1.0f);
+      if (p.w <= kMinW) {
+        return false;
+      }
+      auto s = toScreen(p);
+      x0 = std::min(x0, s.x);
+      y0 = std::min(y0, s.y);
+      x1 = std::max(x1, s.x);
+      y1 = std::max(y1, s.y);
+      near = std::min(near, s.z);
+    }
+    if (near < -1.0f || x1 < 0 || y1 < 0 || x0 >= width_ || y0 >= height_) {
+      return false;
+    }
+
+    // Start from the finest level where the box covers at most 2x2 texels.
+    int ix0 = std::max(0, static_cast<int>(std::floor(x0)) - 1);
+    int iy0 = std::max(0, static_cast<int>(std::floor(y0)) - 1);
+    int ix1 = std::min(width_ - 1, static_cast<int>(x1) + 1);
+    int iy1 = std::min(height_ - 1, static_cast<int>(y1) + 1);
+    size_t level = 0;
+    while (level + 1 < levels_.size() &&
+           ((ix1 >> level) - (ix0 >> level) > 1 ||
+            (iy1 >> level) - (iy0 >> level) > 1)) {
+      level += 1;
+    }
+
+    // Refine texels that are not entirely in front of the box into their
+    // children overlapping the box until reaching single pixels. Each level
+    // descended adds at most three texels to the stack so its depth is bounded
+    // by the number of levels.
+    std::array<std::tuple<int, int, int>, kMaxStackSize> stack;
+    for (int y = iy0 >> level; y <= iy1 >> level; y += 1) {
+      for (int x = ix0 >> level; x <= ix1 >> level; x += 1) {
+        int size = 0;
+        stack[size++] = {static_cast<int>(level), x, y};
+        while (size) {
+          auto [l, tx, ty] = stack[--size];
+          if (levels_[l][ty * (width_ >> l) + tx] < near) {
+            continue;
+          } else if (l == 0) {
+            return false;
+          }
+          for (int cy = 2 * ty; cy <= 2 * ty + 1; cy += 1) {
+            for (int cx = 2 * tx; cx <= 2 * tx + 1; cx += 1) {
+              if (ix0 >> (l - 1) <= cx && cx <= ix1 >> (l - 1) &&
+                  iy0 >> (l - 1) <= cy && cy <= iy1 >> (l - 1)) {
+                stack[size++] = {l - 1, cx, cy};
+              }
+            }
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  static constexpr int kLanes = 8;
+  static constexpr float kMinW = 1e-3f;
+  static constexpr int kMaxLevels = 32;
+  static constexpr int kMaxStackSize = 3 * kMaxLevels + 1;
+
+  using Lanes = Eigen::Array<float, kLanes, 1>;
+
+  // Returns pixel coordinates along with the normalized device depth.
+  glm::vec3 toScreen(const glm::vec4& p) const {
+    return glm::vec3(
+        0.5f * (p.x / p.w + 1.0f) * width_,
+        0.5f * (p.y / p.w + 1.0f) * height_,
+        p.z / p.w);
+  }
+
+  // Rasterizes a convex quad into the finest level, eight pixels at a time.
+  // The quad is clipped to the near plane first so that nearby occluders are
+  // kept.
+  void rasterizeQuad(const std::array<glm::vec3, 4>& corners) {
+    std::array<glm::vec4, 4> clip;
+    for (int i = 0; i < 4; i += 1) {
+      clip[i] = view_proj_ * glm::vec4(corners[i], 1.0f);
+    }
+    std::vector<glm::vec3> s;
+    for (int i = 0; i < 4; i += 1) {
+      const auto& a = clip[i];
+      const auto& b = clip[(i + 1) % 4];
+      auto da = a.z + a.w, db = b.z + b.w;
+      if (da >= 0) {
+        s.push_back(toScreen(a));
+      }
+      if ((da >= 0) != (db >= 0)) {
+        s.push_back(toScreen(a + (b - a) * (da / (da - db))));
+      }
+    }
+    if (s.size() < 3) {
+      return;
+    }
+    for (const auto& p : s) {
+      if (!std::isfinite(p.x) || !std::isfinite(p.y)) {
+        return;
+      }
+    }
+
+    // Orient the polygon counter-clockwise.
+    int count = s.size();
+    float area = 0.0f;
+    for (int i = 0; i < count; i += 1) {
+      const auto& a = s[i];
+      const auto& b = s[(i + 1) % count];
+      area += a.x * b.y - b.x * a.y;
+    }
+    if (std::abs(area) < 1e-6f) {
+      return;
+    }
+    if (area < 0) {
+      std::reverse(s.begin(), s.end());
+    }
+
+    // Depth is affine in screen space for planar primitives.
+    glm::vec3 n(0.0f);
+    for (int i = 2; i < count && std::abs(n.z) < 1e-6f; i += 1) {
+      n = glm::cross(s[i - 1] - s[0], s[i] - s[0]);
+    }
+    if (std::abs(n.z) < 1e-6f) {
+      return;
+    }
+    float da = -n.x / n.z, db = -n.y / n.z;
+    float dc = s[0].z - da * s[0].x - db * s[0].y;
+
+    // Edge functions evaluated at pixel centers.
+    std::array<float, 8> ea, eb, ec;
+    for (int i = 0; i < count; i += 1) {
+      const auto& a = s[i];
+      const auto& b = s[(i + 1) % count];
+      ea[i] = a.y - b.y;
+      eb[i] = b.x - a.x;
+      ec[i] = 0.5f * (ea[i] + eb[i]) - ea[i] * a.x - eb[i] * a.y;
+    }
+
+    // Take the farthest depth over each pixel.
+    dc += std::max(da, 0.0f) + std::max(db, 0.0f);
+
+    float min_x = width_, min_y = height_, max_x = 0, max_y = 0;
+    for (const auto& p : s) {
+      min_x = std::min(min_x, p.x);
+      min_y = std::min(min_y, p.y);
+      max_x = std::max(max_x, p.x);
+      max_y = std::max(max_y, p.y);
+    }
+    int x0 = std::max(0, static_cast<int>(std::floor(min_x))) / kLanes * kLanes;
+    int y0 = std::max(0, static_cast<int>(std::floor(min_y)));
+    int x1 = std::min(width_, static_cast<int>(std::ceil(max_x)));
+    int y1 = std::min(height_, static_cast<int>(std::ceil(max_y)));
+
+    static const Lanes kOffsets =
+        (Lanes() << 0, 1, 2, 3, 4, 5, 6, 7).finished();
+    auto& depths = levels_[0];
+    for (int y = y0; y < y1; y += 1) {
+      for (int x = x0; x < x1; x += kLanes) {
+        Lanes px = x + kOffsets;
+        Eigen::Array<bool, kLanes, 1> inside;
+        inside.setConstant(true);
+        for (int i = 0; i < count; i += 1) {
+          inside = inside && (ea[i] * px + (eb[i] * y + ec[i]) >= 0);
+        }
+        Lanes depth = (da * px + (db * y + dc)).min(1.0f);
+        Eigen::Map<Lanes> dst(&depths[y * width_ + x]);
+        dst = inside.select(dst.min(depth), dst);
+      }
+    }
+  }
+
+  int width_;
+  int height_;
+  glm::vec3 position_;
+  glm::mat4 view_proj_;
+  std::vector<std::vector<float>> levels_;
+};
+
+}  // namespace tequila
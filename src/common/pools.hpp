@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include "src/common/errors.hpp"
+
+namespace tequila {
+
+// Allocates small fixed size blocks out of large chunks and recycles freed
+// blocks through a free list per block size. This avoids a trip to the general
+// purpose allocator for each of many small, similarly sized objects.
+class BlockPool {
+ public:
+  static constexpr size_t kDefaultChunkSize = 1 << 16;
+
+  BlockPool(size_t chunk_size = kDefaultChunkSize)
+      : chunk_size_(chunk_size), chunk_offset_(chunk_size) {}
+
+  BlockPool(const BlockPool&) = delete;
+  BlockPool& operator=(const BlockPool&) = delete;
+
+  void* allocate(size_t size) {
+    size = blockSize(size);
+    if (size > chunk_size_ / 4) {
+      return ::operator new(size);
+    }
+
+    std::lock_guard lock(mutex_);
+    auto& free_list = free_lists_[size];
+    if (free_list) {
+      auto block = free_list;
+      free_list = block->next;
+      return block;
+    }
+    if (chunk_offset_ + size > chunk_size_) {
+      chunks_.emplace_back(new std::max_align_t[chunk_size_ / kAlignment]);
+      chunk_offset_ = 0;
+    }
+    auto block = reinterpret_cast<char*>(chunks_.back().get()) + chunk_offset_;
+    chunk_offset_ += size;
+    return block;
+  }
+
+  void deallocate(void* ptr, size_t size) {
+    size = blockSize(size);
+    if (size > chunk_size_ / 4) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    std::lock_guard lock(mutex_);
+    auto& free_list = free_lists_[size];
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = free_list;
+    free_list = block;
+  }
+
+  // Returns the number of bytes reserved in chunks.
+  size_t capacity() {
+    std::lock_guard lock(mutex_);
+    return chunks_.size() * chunk_size_;
+  }
+
+ private:
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  static size_t blockSize(size_t size) {
+    size = std::max(size, sizeof(FreeBlock));
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+  std::mutex mutex_;
+  size_t chunk_size_;
+  size_t chunk_offset_;
+  std::vector<std::unique_ptr<std::max_align_t[]>> chunks_;
+  std::unordered_map<size_t, FreeBlock*> free_lists_;
+};
+
+// A standard allocator drawing from a shared block pool. Each allocator keeps
+// its pool alive so that objects may outlive their creator (e.g. when used
+// with std::allocate_shared).
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  static_assert(alignof(T) <= alignof(std::max_align_t));
+
+  PoolAllocator(std::shared_ptr<BlockPool> pool) : pool_(std::move(pool)) {
+    ENFORCE(pool_);
+  }
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) : pool_(other.pool()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    pool_->deallocate(ptr, n * sizeof(T));
+  }
+
+  const auto& pool() const {
+    return pool_;
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>& other) const {
+    return pool_ == other.pool();
+  }
+
+  template <typename U>
+  bool operator!=(const PoolAllocator<U>& other) const {
+    return pool_ != other.pool();
+  }
+
+ private:
+  std::shared_ptr<BlockPool> pool_;
+};
+
+}  // namespace tequila
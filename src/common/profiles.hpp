@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "src/common/errors.hpp"
+#include "src/common/strings.hpp"
+
+namespace tequila {
+
+using ProfileClock = std::chrono::steady_clock;
+
+// Build latencies are bucketed by powers of two in microseconds, i.e. bucket i
+// counts builds taking [2^i, 2^(i+1)) microseconds.
+static constexpr size_t kLatencyBuckets = 24;
+
+// Value types may report the memory they own by defining either of:
+//   size_t cpuBytes() const;  // Host memory including sizeof(*this).
+//   size_t gpuBytes() const;  // Device memory, e.g. buffers and textures.
+template <typename T, typename = void>
+struct HasCpuBytes : std::false_type {};
+
+template <typename T>
+struct HasCpuBytes<
+    T,
+    std::void_t<decltype(std::declval<const T&>().cpuBytes())>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct HasGpuBytes : std::false_type {};
+
+template <typename T>
+struct HasGpuBytes<
+    T,
+    std::void_t<decltype(std::declval<const T&>().gpuBytes())>>
+    : std::true_type {};
+
+// Returns an estimate of the number of bytes owned by a resource value.
+template <typename T>
+size_t sizeOf(const T& value);
+template <typename T>
+size_t sizeOf(const std::shared_ptr<T>& ptr);
+template <typename T>
+size_t sizeOf(const std::vector<T>& values);
+inline size_t sizeOf(const std::string& value);
+
+// Returns an estimate of the number of bytes of device memory owned by a
+// resource value.
+template <typename T>
+size_t gpuSizeOf(const T& value);
+template <typename T>
+size_t gpuSizeOf(const std::shared_ptr<T>& ptr);
+template <typename T>
+size_t gpuSizeOf(const std::vector<T>& values);
+
+template <typename T>
+size_t sizeOf(const T& value) {
+  if constexpr (HasCpuBytes<T>::value) {
+    return value.cpuBytes();
+  } else {
+    return sizeof(T);
+  }
+}
+
+template <typename T>
+size_t sizeOf(const std::shared_ptr<T>& ptr) {
+  return sizeof(ptr) + (ptr ? sizeOf(*ptr) : 0);
+}
+
+template <typename T>
+size_t sizeOf(const std::vector<T>& values) {
+  size_t ret = sizeof(values) + (values.capacity() - values.size()) * sizeof(T);
+  if constexpr (std::is_trivially_copyable_v<T>) {
+    ret += values.size() * sizeof(T);
+  } else {
+    for (const auto& value : values) {
+      ret += sizeOf(value);
+    }
+  }
+  return ret;
+}
+
+inline size_t sizeOf(const std::string& value) {
+  return sizeof(value) + value.capacity();
+}
+
+template <typename T>
+size_t gpuSizeOf(const T& value) {
+  if constexpr (HasGpuBytes<T>::value) {
+    return value.gpuBytes();
+  } else {
+    return 0;
+  }
+}
+
+template <typename T>
+size_t gpuSizeOf(const std::shared_ptr<T>& ptr) {
+  return ptr ? gpuSizeOf(*ptr) : 0;
+}
+
+template <typename T>
+size_t gpuSizeOf(const std::vector<T>& values) {
+  size_t ret = 0;
+  if constexpr (!std::is_trivially_copyable_v<T>) {
+    for (const auto& value : values) {
+      ret += gpuSizeOf(value);
+    }
+  }
+  return ret;
+}
+
+// A snapshot of the counters for a single resource (or an aggregate of them).
+struct ResourceProfile {
+  std::string type;
+  uint64_t key = 0;
+  int64_t builds = 0;
+  int64_t restores = 0;
+  int64_t hits = 0;
+  int64_t misses = 0;
+  int64_t stale_reads = 0;
+  int64_t invalidations = 0;
+  int64_t invalidation_fan_out = 0;
+  size_t value_size = 0;
+  size_t gpu_size = 0;
+  double total_build_seconds = 0.0;
+  double max_build_seconds = 0.0;
+  std::array<int64_t, kLatencyBuckets> build_latency{};
+
+  void merge(const ResourceProfile& other) {
+    builds += other.builds;
+    restores += other.restores;
+    hits += other.hits;
+    misses += other.misses;
+    stale_reads += other.stale_reads;
+    invalidations += other.invalidations;
+    invalidation_fan_out += other.invalidation_fan_out;
+    value_size += other.value_size;
+    gpu_size += other.gpu_size;
+    total_build_seconds += other.total_build_seconds;
+    max_build_seconds = std::max(max_build_seconds, other.max_build_seconds);
+    for (size_t i = 0; i < kLatencyBuckets; i += 1) {
+      build_latency[i] += other.build_latency[i];
+    }
+  }
+};
+
+// Lock-free counters kept by each resource generator.
+class ResourceCounters {
+ public:
+  ResourceCounters()
+      : builds_(0),
+        restores_(0),
+        hits_(0),
+        misses_(0),
+        stale_reads_(0),
+        invalidations_(0),
+        invalidation_fan_out_(0),
+        value_size_(0),
+        gpu_size_(0),
+        total_build_micros_(0),
+        max_build_micros_(0) {
+    for (auto& bucket : build_latency_) {
+      bucket = 0;
+    }
+  }
+
+  void hit() {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Records a value restored from persistent storage instead of built.
+  void restored() {
+    restores_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void miss() {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void staleRead() {
+    stale_reads_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Records an invalidation of this resource that cleared fan_out generators.
+  void invalidated(size_t fan_out) {
+    invalidations_.fetch_add(1, std::memory_order_relaxed);
+    invalidation_fan_out_.fetch_add(fan_out, std::memory_order_relaxed);
+  }
+
+  // Records the size of the latest value (see sizeOf and gpuSizeOf).
+  void resized(size_t value_size, size_t gpu_size) {
+    value_size_.store(value_size, std::memory_order_relaxed);
+    gpu_size_.store(gpu_size, std::memory_order_relaxed);
+  }
+
+  void built(ProfileClock::duration duration) {
+    using namespace std::chrono;
+    int64_t micros = duration_cast<microseconds>(duration).count();
+    size_t bucket = 0;
+    while (bucket + 1 < kLatencyBuckets && (2ll << bucket) <= micros) {
+      bucket += 1;
+    }
+    builds_.fetch_add(1, std::memory_order_relaxed);
+    build_latency_[bucket].fetch_add(1, std::memory_order_relaxed);
+    total_build_micros_.fetch_add(micros, std::memory_order_relaxed);
+    auto max = max_build_micros_.load(std::memory_order_relaxed);
+    while (max < micros && !max_build_micros_.compare_exchange_weak(
+                               max, micros, std::memory_order_relaxed)) {
+    }
+  }
+
+  ResourceProfile profile() const {
+    ResourceProfile ret;
+    ret.builds = builds_;
+    ret.restores = restores_;
+    ret.hits = hits_;
+    ret.misses = misses_;
+    ret.stale_reads = stale_reads_;
+    ret.invalidations = invalidations_;
+    ret.invalidation_fan_out = invalidation_fan_out_;
+    ret.value_size = value_size_;
+    ret.gpu_size = gpu_size_;
+    ret.total_build_seconds = 1e-6 * total_build_micros_;
+    ret.max_build_seconds = 1e-6 * max_build_micros_;
+    for (size_t i = 0; i < kLatencyBuckets; i += 1) {
+      ret.build_latency[i] = build_latency_[i];
+    }
+    return ret;
+  }
+
+ private:
+  std::atomic<int64_t> builds_;
+  std::atomic<int64_t> restores_;
+  std::atomic<int64_t> hits_;
+  std::atomic<int64_t> misses_;
+  std::atomic<int64_t> stale_reads_;
+  std::atomic<int64_t> invalidations_;
+  std::atomic<int64_t> invalidation_fan_out_;
+  std::atomic<size_t> value_size_;
+  std::atomic<size_t> gpu_size_;
+  std::atomic<int64_t> total_build_micros_;
+  std::atomic<int64_t> max_build_micros_;
+  std::array<std::atomic<int64_t>, kLatencyBuckets> build_latency_;
+};
+
+// Sums the profiles of all resources sharing a type.
+inline auto aggregateProfiles(const std::vector<ResourceProfile>& profiles) {
+  std::unordered_map<std::string, ResourceProfile> ret;
+  for (const auto& profile : profiles) {
+    auto& aggregate = ret[profile.type];
+    aggregate.type = profile.type;
+    aggregate.merge(profile);
+  }
+  return ret;
+}
+
+// The memory held by the cached values of all resources of one type.
+struct ResourceMemory {
+  std::string type;
+  int64_t values = 0;
+  int64_t cpu_bytes = 0;
+  int64_t gpu_bytes = 0;
+};
+
+// Lock-free totals shared by the generators of one resource type. Generators
+// apply the change in size each time they replace their value so reading the
+// totals doesn't require visiting every generator.
+class ResourceMemoryCounters {
+ public:
+  ResourceMemoryCounters(std::string type)
+      : type_(std::move(type)), values_(0), cpu_bytes_(0), gpu_bytes_(0) {}
+
+  void add(int64_t values, int64_t cpu_bytes, int64_t gpu_bytes) {
+    values_.fetch_add(values, std::memory_order_relaxed);
+    cpu_bytes_.fetch_add(cpu_bytes, std::memory_order_relaxed);
+    gpu_bytes_.fetch_add(gpu_bytes, std::memory_order_relaxed);
+  }
+
+  ResourceMemory memory() const {
+    ResourceMemory ret;
+    ret.type = type_;
+    ret.values = values_;
+    ret.cpu_bytes = cpu_bytes_;
+    ret.gpu_bytes = gpu_bytes_;
+    return ret;
+  }
+
+ private:
+  std::string type_;
+  std::atomic<int64_t> values_;
+  std::atomic<int64_t> cpu_bytes_;
+  std::atomic<int64_t> gpu_bytes_;
+};
+
+struct ResourceBuildEvent {
+  const char* type;  // Points to the static type name (see std::type_info).
+  uint64_t key;
+  std::thread::id thread;
+  ProfileClock::time_point start;
+  ProfileClock::time_point finish;
+  std::vector<uint64_t> deps;
+};
+
+// Keeps a bounded timeline of resource builds which can be exported in the
+// Chrome trace event format (viewable in chrome://tracing or Perfetto). Events
+// are only recorded while enabled so that builds don't pay for it otherwise.
+class ResourceProfiler {
+ public:
+  static constexpr size_t kDefaultCapacity = 1 << 16;
+
+  ResourceProfiler(size_t capacity = kDefaultCapacity)
+      : enabled_(false),
+        capacity_(capacity),
+        next_(0),
+        epoch_(ProfileClock::now()) {
+    ENFORCE(capacity_ > 0);
+  }
+
+  bool isEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  void record(ResourceBuildEvent event) {
+    std::lock_guard lock(mutex_);
+    if (events_.size() < capacity_) {
+      events_.push_back(std::move(event));
+    } else {
+      events_[next_] = std::move(event);
+    }
+    next_ = (next_ + 1) % capacity_;
+  }
+
+  // Returns the recorded events ordered by when they finished.
+  std::vector<ResourceBuildEvent> events() {
+    std::lock_guard lock(mutex_);
+    std::vector<ResourceBuildEvent> ret;
+    ret.reserve(events_.size());
+    if (events_.size() == capacity_) {
+      ret.insert(ret.end(), events_.begin() + next_, events_.end());
+      ret.insert(ret.end(), events_.begin(), events_.begin() + next_);
+    } else {
+      ret = events_;
+    }
+    return ret;
+  }
+
+  // Returns the timeline as Chrome trace JSON. Each build is a slice on the
+  // thread that started it and each dependency edge is a flow arrow from the
+  // end of the dependency's latest preceding build.
+  std::string chromeTrace() {
+    auto events = this->events();
+    std::unordered_map<std::thread::id, int> threads;
+    std::unordered_map<uint64_t, size_t> latest_builds;
+    std::vector<std::string> trace_events;
+    int64_t flow_id = 0;
+    for (size_t i = 0; i < events.size(); i += 1) {
+      const auto& event = events[i];
+      auto tid = threads.emplace(event.thread, threads.size()).first->second;
+      trace_events.push_back(format(
+          "{\"name\":\"%1%\",\"cat\":\"resource\",\"ph\":\"X\",\"pid\":0,"
+          "\"tid\":%2%,\"ts\":%3%,\"dur\":%4%,"
+          "\"args\":{\"key\":\"%5%\",\"deps\":%6%}}",
+          escape(event.type),
+          tid,
+          micros(event.start),
+          micros(event.finish) - micros(event.start),
+          event.key,
+          event.deps.size()));
+      for (auto dep : event.deps) {
+        if (!latest_builds.count(dep)) {
+          continue;
+        }
+        const auto& source = events[latest_builds.at(dep)];
+        flow_id += 1;
+        trace_events.push_back(format(
+            "{\"name\":\"dep\",\"cat\":\"resource\",\"ph\":\"s\",\"pid\":0,"
+            "\"tid\":%1%,\"ts\":%2%,\"id\":%3%}",
+            threads.at(source.thread),
+            micros(source.finish),
+            flow_id));
+        trace_events.push_back(format(
+            "{\"name\":\"dep\",\"cat\":\"resource\",\"ph\":\"f\",\"bp\":\"e\","
+            "\"pid\":0,\"tid\":%1%,\"ts\":%2%,\"id\":%3%}",
+            tid,
+            micros(event.start),
+            flow_id));
+      }
+      latest_builds[event.key] = i;
+    }
+    for (const auto& pair : threads) {
+      trace_events.push_back(format(
+          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%1%,"
+          "\"args\":{\"name\":\"thread %1%\"}}",
+          pair.second));
+    }
+
+    std::stringstream ss;
+    ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < trace_events.size(); i += 1) {
+      ss << (i ? ",\n" : "\n") << trace_events[i];
+    }
+    ss << "\n]}\n";
+    return ss.str();
+  }
+
+  void writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    ENFORCE(out.good(), format("Unable to write trace to: %1%", path));
+    out << chromeTrace();
+  }
+
+ private:
+  int64_t micros(ProfileClock::time_point time) const {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(time - epoch_).count();
+  }
+
+  static std::string escape(const std::string& s) {
+    std::string ret;
+    for (auto c : s) {
+      if (c == '"' || c == '\\') {
+        ret.push_back('\\');
+      }
+      ret.push_back(c);
+    }
+    return ret;
+  }
+
+  std::atomic<bool> enabled_;
+  std::mutex mutex_;
+  size_t capacity_;
+  size_t next_;
+  ProfileClock::time_point epoch_;
+  std::vector<ResourceBuildEvent> events_;
+};
+
+}  // namespace tequila
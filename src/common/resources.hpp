@@ -1,13 +1,22 @@
 #pragma once
 
 #include <boost/any.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/container_hash/extensions.hpp>
 #include <boost/optional.hpp>
+#include <cereal/types/common.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/tuple.hpp>
+#include <cereal/types/vector.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <mutex>
+#include <random>
 #include <shared_mutex>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <typeindex>
@@ -16,8 +25,12 @@
 
 #include "src/common/caches.hpp"
 #include "src/common/concurrency.hpp"
+#include "src/common/data.hpp"
 #include "src/common/errors.hpp"
 #include "src/common/functions.hpp"
+#include "src/common/pools.hpp"
+#include "src/common/profiles.hpp"
+#include "src/common/stats.hpp"
 #include "src/common/utils.hpp"
 
 namespace tequila {
@@ -25,6 +38,13 @@ namespace tequila {
 class Resources;
 class ResourceDeps;
 
+// Hashing a type index hashes the type name so it's cached per resource.
+template <typename Resource>
+size_t resourceTypeHash() {
+  static const size_t ret = std::type_index(typeid(Resource)).hash_code();
+  return ret;
+}
+
 // Extracts a key tuple for Resources defined with non-const factories.
 template <
     typename Resource,
@@ -36,9 +56,9 @@ auto resourceHashTuple(
     Return (Class::*factory_fn)(ResourceDeps&, Args...),
     int seed,
     const Keys&... keys)
-    -> std::tuple<std::type_index, int, std::decay_t<Args>...> {
-  return std::tuple<std::type_index, int, std::decay_t<Args>...>(
-      std::type_index(typeid(Resource)), seed, keys...);
+    -> std::tuple<size_t, int, std::decay_t<Args>...> {
+  return std::tuple<size_t, int, std::decay_t<Args>...>(
+      resourceTypeHash<Resource>(), seed, keys...);
 }
 
 // Extracts a key tuple for Resources defined with const factories.
@@ -52,9 +72,9 @@ auto resourceHashTuple(
     Return (Class::*factory_fn)(ResourceDeps&, Args...) const,
     int seed,
     const Keys&... keys)
-    -> std::tuple<std::type_index, int, std::decay_t<Args>...> {
-  return std::tuple<std::type_index, int, std::decay_t<Args>...>(
-      std::type_index(typeid(Resource)), seed, keys...);
+    -> std::tuple<size_t, int, std::decay_t<Args>...> {
+  return std::tuple<size_t, int, std::decay_t<Args>...>(
+      resourceTypeHash<Resource>(), seed, keys...);
 }
 
 // Generates a 64-bit hash of a resource key tuple.
@@ -69,6 +89,213 @@ uint64_t resourceHash(const Keys&... keys) {
   return (hi << 32) + lo;
 }
 
+// Extracts the decayed key types of a resource factory.
+template <typename Return, typename Class, typename... Args>
+auto resourceKeysTuple(Return (Class::*factory_fn)(ResourceDeps&, Args...))
+    -> std::tuple<std::decay_t<Args>...>;
+
+template <typename Return, typename Class, typename... Args>
+auto resourceKeysTuple(
+    Return (Class::*factory_fn)(ResourceDeps&, Args...) const)
+    -> std::tuple<std::decay_t<Args>...>;
+
+template <typename Resource>
+using ResourceKeys = decltype(resourceKeysTuple(&Resource::operator()));
+
+// Resource keys need to be serializable to persist values depending on them.
+template <typename Tuple>
+struct SerializableKeys;
+
+template <typename... Keys>
+struct SerializableKeys<std::tuple<Keys...>> {
+  using Archive = cereal::BinaryOutputArchive;
+  static constexpr bool value =
+      (cereal::traits::is_output_serializable<Keys, Archive>::value && ...);
+};
+
+template <typename Resource>
+constexpr bool kSerializableKeys =
+    SerializableKeys<ResourceKeys<Resource>>::value;
+
+// Resources opt into persistence across runs by declaring:
+//   static constexpr bool kPersistent = true;
+template <typename Resource, typename = void>
+struct IsPersistent : std::false_type {};
+
+template <typename Resource>
+struct IsPersistent<Resource, std::void_t<decltype(Resource::kPersistent)>>
+    : std::bool_constant<Resource::kPersistent> {};
+
+// Resources may define a content digest of their values:
+//   static uint64_t digest(const Value& value);
+// Otherwise a resource's digest combines its key with the digests of its
+// dependencies. Resources without either get a digest unique to the process
+// so that values depending on them are never restored in a later run. Digests
+// are compared across runs so they must use a stable hash (see stableHash).
+template <typename Resource, typename Value, typename = void>
+struct HasDigest : std::false_type {};
+
+template <typename Resource, typename Value>
+struct HasDigest<
+    Resource,
+    Value,
+    std::void_t<decltype(Resource::digest(std::declval<const Value&>()))>>
+    : std::true_type {};
+
+inline uint64_t processDigestSeed() {
+  static const uint64_t seed = [] {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) + device();
+  }();
+  return seed;
+}
+
+// Describes a dependency of a persisted value so that it can be regenerated
+// and validated in a later run.
+struct PersistedDependency {
+  std::string type;
+  std::string keys;
+  uint64_t digest;
+
+  template <typename Archive>
+  void serialize(Archive& archive) {
+    archive(type, keys, digest);
+  }
+};
+
+struct PersistedResource {
+  std::string keys;
+  uint64_t digest;
+  std::vector<PersistedDependency> deps;
+  std::string value;
+
+  template <typename Archive>
+  void serialize(Archive& archive) {
+    archive(keys, digest, deps, value);
+  }
+};
+
+// Storage for persisted resource values (see ResourcesBuilder::withStore).
+class ResourceStore {
+ public:
+  virtual ~ResourceStore() = default;
+  virtual boost::optional<std::string> load(const std::string& key) = 0;
+  virtual void save(const std::string& key, const std::string& data) = 0;
+};
+
+// Stores persisted resource values in a side SQLite table.
+class TableResourceStore : public ResourceStore {
+ public:
+  TableResourceStore(std::shared_ptr<Table> table) : table_(std::move(table)) {}
+
+  boost::optional<std::string> load(const std::string& key) override {
+    std::lock_guard lock(mutex_);
+    boost::optional<std::string> ret;
+    if (table_->has(key)) {
+      ret = table_->get(key);
+    }
+    return ret;
+  }
+
+  void save(const std::string& key, const std::string& data) override {
+    std::lock_guard lock(mutex_);
+    table_->set(key, data);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::shared_ptr<Table> table_;
+};
+
+template <typename T>
+struct IsSharedPtr : std::false_type {};
+
+template <typename T>
+struct IsSharedPtr<std::shared_ptr<T>> : std::true_type {};
+
+template <typename Value>
+std::string serializeValue(const Value& value) {
+  if constexpr (IsSharedPtr<Value>::value) {
+    return serialize(*value);
+  } else {
+    return serialize(value);
+  }
+}
+
+template <typename Value>
+Value deserializeValue(const std::string& data) {
+  if constexpr (IsSharedPtr<Value>::value) {
+    using Element = typename Value::element_type;
+    return std::make_shared<Element>(deserialize<Element>(data));
+  } else {
+    return deserialize<Value>(data);
+  }
+}
+
+// A set of resource keys stored inline while small. Most resources only have
+// a few subscribers but some (e.g. configs) are shared by nearly all others.
+class ResourceKeySet {
+ public:
+  static constexpr size_t kInlineKeys = 4;
+  static constexpr size_t kMaxVectorKeys = 32;
+
+  bool insert(uint64_t key) {
+    if (set_) {
+      return set_->insert(key).second;
+    }
+    if (std::find(keys_.begin(), keys_.end(), key) != keys_.end()) {
+      return false;
+    }
+    if (keys_.size() < kMaxVectorKeys) {
+      keys_.push_back(key);
+    } else {
+      set_ = std::make_unique<std::unordered_set<uint64_t>>(
+          keys_.begin(), keys_.end());
+      set_->insert(key);
+      keys_.clear();
+    }
+    return true;
+  }
+
+  bool erase(uint64_t key) {
+    if (set_) {
+      return set_->erase(key);
+    }
+    auto it = std::find(keys_.begin(), keys_.end(), key);
+    if (it == keys_.end()) {
+      return false;
+    }
+    *it = keys_.back();
+    keys_.pop_back();
+    return true;
+  }
+
+  void clear() {
+    keys_.clear();
+    set_.reset();
+  }
+
+  template <typename Container>
+  void appendTo(Container& container) const {
+    if (set_) {
+      container.insert(container.end(), set_->begin(), set_->end());
+    } else {
+      container.insert(container.end(), keys_.begin(), keys_.end());
+    }
+  }
+
+ private:
+  boost::container::small_vector<uint64_t, kInlineKeys> keys_;
+  std::unique_ptr<std::unordered_set<uint64_t>> set_;
+};
+
+class ResourceGeneratorBase;
+
+// Registers a function to look up generators of the resource by serialized
+// keys. This allows dependencies of persisted values to be validated.
+template <typename Resource>
+bool registerResourceLoader();
+
 class ResourceGeneratorBase {
  public:
   virtual ~ResourceGeneratorBase() = default;
@@ -85,11 +312,30 @@ class ResourceGeneratorBase {
   // Atomically adds the resource with the given key as a subscriber.
   virtual void subscribe(uint64_t resource_key) = 0;
 
-  // Atomically returns the resource keys of the current subscribers.
-  virtual std::shared_ptr<std::unordered_set<uint64_t>> subscribers() = 0;
+  // Atomically appends the resource keys of the current subscribers.
+  virtual void subscribers(std::vector<uint64_t>& keys) = 0;
 
-  // Atomically returns the resource keys of the current dependencies.
-  virtual std::shared_ptr<std::unordered_set<uint64_t>> dependencies() = 0;
+  // Atomically appends the resource keys of the current dependencies.
+  virtual void dependencies(std::vector<uint64_t>& keys) = 0;
+
+  // Returns the profiling counters of this generator.
+  virtual ResourceCounters& counters() = 0;
+
+  // Makes sure the value is up to date.
+  virtual void refresh() = 0;
+
+  // Returns the digest of the current value (see HasDigest).
+  virtual uint64_t digest() = 0;
+
+  // Returns true if the digest of the current value is unique to the process.
+  virtual bool isVolatile() = 0;
+
+  // Returns the serialized keys if they are serializable.
+  virtual boost::optional<std::string> serializedKeys() = 0;
+
+  // Returns a key that identifies this generator across runs (unlike key)
+  // if its keys are serializable.
+  virtual boost::optional<uint64_t> stableKey() = 0;
 
   // Clears the resource version and returns the current subscribers.
   virtual void clear() = 0;
@@ -98,9 +344,11 @@ class ResourceGeneratorBase {
   virtual bool stale() = 0;
 };
 
+// Resource factories may return either a value or an AsyncResult of a value
+// (e.g. when the last step of the build is queued on the OpenGL thread).
 template <typename Resource>
-using ResourceValue =
-    typename decltype(make_function(&Resource::operator()))::result_type;
+using ResourceValue = typename UnwrapAsyncResult<
+    typename decltype(make_function(&Resource::operator()))::result_type>::type;
 
 // Reduced interface exposed to resource factories allowing dependency injection
 // of other resources. The dependencies are tracked to allow update propagation.
@@ -112,6 +360,17 @@ class ResourceDeps {
   template <typename Resource, typename... Keys>
   ResourceValue<Resource> get(const Keys&... keys);
 
+  // Like get but returns a result so that asynchronous factories can attach
+  // continuations instead of blocking on dependencies (see whenAll).
+  template <typename Resource, typename... Keys>
+  AsyncResult<ResourceValue<Resource>> getAsync(const Keys&... keys);
+
+  // Fetches the resource for each key, building any missing values in
+  // parallel on the resources' executor. Values are returned in key order.
+  template <typename Resource, typename Key>
+  AsyncResult<std::vector<ResourceValue<Resource>>> getAll(
+      const std::vector<Key>& keys);
+
   auto& deps() {
     return deps_;
   }
@@ -119,8 +378,12 @@ class ResourceDeps {
  private:
   using DepPtr = std::shared_ptr<ResourceGeneratorBase>;
 
+  template <typename Resource, typename... Keys>
+  auto subscribe(const Keys&... keys);
+
   Resources& resources_;
   uint64_t resource_key_;
+  std::mutex mutex_;
   std::unordered_map<uint64_t, DepPtr> deps_;
 };
 
@@ -131,54 +394,30 @@ class ResourceGenerator : public ResourceGeneratorBase {
   using Value = ResourceValue<Resource>;
 
  public:
-  template <typename Function, typename... Keys>
-  ResourceGenerator(Resources& resources, Function fn, const Keys&... keys)
+  // The factory overriding the resource's or null to use the resource.
+  using Factory = decltype(make_function(&Resource::operator()));
+
+  template <typename... Keys>
+  ResourceGenerator(
+      Resources& resources,
+      const Factory* factory,
+      std::shared_ptr<ResourceMemoryCounters> memory,
+      const Keys&... keys)
       : resources_(resources),
         key_(resourceHash<Resource>(keys...)),
+        keys_(keys...),
+        factory_(factory),
+        memory_(std::move(memory)),
+        cpu_size_(0),
+        gpu_size_(0),
         version_(0),
         requested_version_(1),
-        cached_subs_(std::make_shared<std::unordered_set<uint64_t>>()),
-        cached_deps_(std::make_shared<std::unordered_set<uint64_t>>()) {
-    generator_ = [this, fn = std::move(fn), keys = std::make_tuple(keys...)] {
-      std::lock_guard<std::mutex> generator_lock(generator_mutex_);
-
-      // Return if the current version is up to date.
-      ENFORCE(version_ <= requested_version_);
-      if (version_ == requested_version_) {
-        return *get_ptr();
-      }
-
-      // Build a new version.
-      uint64_t version = requested_version_.load();
-      ResourceDeps deps(resources_, key_);
-      auto value = std::apply(
-          [&](const auto&... keys) {
-            return std::make_shared<Value>(fn(deps, keys...));
-          },
-          keys);
-
-      // We need to make sure that the old value isn't destroyed under the
-      // mutex otherwise we could deadlock.
-      auto old_value = value_;
-
-      // Update the value to the new version if its the latest and make sure
-      // that dependency subscription lists match the latest version.
-      if (version == requested_version_) {
-        std::lock_guard lock(mutex_);
-        value_ = value;
-        auto& new_deps = deps.deps();
-        for (const auto& pair : deps_) {
-          if (!new_deps.count(pair.first)) {
-            pair.second->unsubscribe(key_);
-          }
-        }
-        deps_.swap(new_deps);
-        cacheDeps();
-        version_ = version;
-      }
-
-      return *value;
-    };
+        building_version_(0),
+        digest_(0),
+        volatile_(true) {
+    if constexpr (kSerializableKeys<Resource>) {
+      ENFORCE(kRegistered);
+    }
   }
 
   ~ResourceGenerator() {
@@ -186,22 +425,121 @@ class ResourceGenerator : public ResourceGeneratorBase {
     for (const auto& pair : deps_) {
       pair.second->unsubscribe(key_);
     }
+    if (value_) {
+      memory_->add(-1, -cpu_size_, -gpu_size_);
+    }
   }
 
-  // Returns a pointer to the currently cached value atomically.
-  auto get_ptr() {
+  // Returns a copy of the currently cached value atomically.
+  boost::optional<Value> cachedValue() {
     std::shared_lock lock(mutex_);
     return value_;
   }
 
   // Returns the value atomically with caching.
-  auto get() {
-    if (auto ptr = get_ptr()) {
+  Value get() {
+    if (!stale()) {
+      if (auto value = cachedValue()) {
+        counters_.hit();
+        return std::move(*value);
+      }
+    }
+    return wait(getAsync());
+  }
+
+  ResourceCounters& counters() override {
+    return counters_;
+  }
+
+  void refresh() override {
+    get();
+  }
+
+  uint64_t digest() override {
+    std::shared_lock lock(mutex_);
+    return digest_;
+  }
+
+  bool isVolatile() override {
+    std::shared_lock lock(mutex_);
+    return volatile_;
+  }
+
+  boost::optional<std::string> serializedKeys() override {
+    boost::optional<std::string> ret;
+    if constexpr (kSerializableKeys<Resource>) {
+      ret = serialize(keys_);
+    }
+    return ret;
+  }
+
+  boost::optional<uint64_t> stableKey() override {
+    boost::optional<uint64_t> ret;
+    if (auto keys = serializedKeys()) {
+      ret = stableHash(*keys, stableHash(typeid(Resource).name()));
+    }
+    return ret;
+  }
+
+  // Returns true if the cached value is up to date.
+  bool fresh() {
+    std::shared_lock lock(mutex_);
+    return value_ && !stale();
+  }
+
+  // Returns a result fulfilled with the value once it is up to date. If a
+  // build of the latest version is already in flight then its result is
+  // shared rather than building the value again. The factory itself runs on
+  // the calling thread, so this only avoids blocking on the parts of the
+  // build that the factory makes asynchronous. Use Resources::schedule (or
+  // ResourceDeps::getAll) to offload the build to the executor.
+  AsyncResult<Value> getAsync() {
+    if (auto value = cachedValue()) {
       if (!stale()) {
-        return *ptr;
+        counters_.hit();
+        return makeReadyAsyncResult(std::move(*value));
+      }
+      counters_.staleRead();
+    } else {
+      counters_.miss();
+    }
+
+    // Return if the current version is up to date or is already being built.
+    AsyncResult<Value> ret;
+    uint64_t version;
+    {
+      std::lock_guard<std::mutex> generator_lock(generator_mutex_);
+      version = requested_version_.load();
+      ENFORCE(version_ <= version);
+      if (version_ == version) {
+        return makeReadyAsyncResult(*cachedValue());
+      }
+      if (building_ && building_version_ == version) {
+        return *building_;
       }
+      building_ = ret;
+      building_version_ = version;
     }
-    return generator_();
+
+    // Build a new version outside of the lock so that asynchronous factories
+    // don't block other callers.
+    AsyncResult<Value> result;
+    try {
+      result = build(version);
+    } catch (...) {
+      result = AsyncResult<Value>();
+      result.setException(std::current_exception());
+    }
+    result.onReady([this, ret, version](const AsyncResult<Value>& result) {
+      {
+        std::lock_guard<std::mutex> generator_lock(generator_mutex_);
+        if (building_version_ == version) {
+          building_ = boost::none;
+        }
+      }
+      result.forward(ret);
+    });
+    return ret;
   }
 
   // Returns key uniquely identifying this generator.
@@ -217,31 +555,27 @@ class ResourceGenerator : public ResourceGeneratorBase {
   // Atomically removes the resource with the given key as a subscriber.
   void unsubscribe(uint64_t resource_key) override {
     std::lock_guard lock(mutex_);
-    if (subs_.count(resource_key)) {
-      subs_.erase(resource_key);
-      cacheSubs();
-    }
+    subs_.erase(resource_key);
   }
 
   // Atomically adds the resource with the given key as a subscriber.
   void subscribe(uint64_t resource_key) override {
     std::lock_guard lock(mutex_);
-    if (!subs_.count(resource_key)) {
-      subs_.insert(resource_key);
-      cacheSubs();
-    }
+    subs_.insert(resource_key);
   }
 
-  // Atomically returns the resource keys of the current subscribers.
-  std::shared_ptr<std::unordered_set<uint64_t>> subscribers() override {
+  // Atomically appends the resource keys of the current subscribers.
+  void subscribers(std::vector<uint64_t>& keys) override {
     std::shared_lock lock(mutex_);
-    return cached_subs_;
+    subs_.appendTo(keys);
   }
 
-  // Atomically returns the resource keys of the current dependencies.
-  std::shared_ptr<std::unordered_set<uint64_t>> dependencies() override {
+  // Atomically appends the resource keys of the current dependencies.
+  void dependencies(std::vector<uint64_t>& keys) override {
     std::shared_lock lock(mutex_);
-    return cached_deps_;
+    for (const auto& pair : deps_) {
+      keys.push_back(pair.first);
+    }
   }
 
   // Deletes the resource version and returns the current subscribers.
@@ -257,38 +591,182 @@ class ResourceGenerator : public ResourceGeneratorBase {
   }
 
  private:
-  void cacheDeps() {
-    cached_deps_->clear();
-    for (const auto& pair : deps_) {
-      cached_deps_->insert(pair.first);
+  AsyncResult<Value> build(uint64_t version) {
+    auto start = ProfileClock::now();
+    auto thread = std::this_thread::get_id();
+
+    // The dependencies need to outlive the factory call since asynchronous
+    // factories may still fetch dependencies after returning.
+    auto deps = std::make_shared<ResourceDeps>(resources_, key_);
+    if constexpr (IsPersistent<Resource>::value) {
+      if (auto value = restore(version, *deps)) {
+        counters_.restored();
+        return makeReadyAsyncResult(std::move(*value));
+      }
+    }
+    auto result = std::apply(
+        [&](const auto&... keys) {
+          if (factory_) {
+            return toAsyncResult((*factory_)(*deps, keys...));
+          } else {
+            return toAsyncResult(Resource()(*deps, keys...));
+          }
+        },
+        keys_);
+    return result.then([this, deps, version, start, thread](
+                           const Value& value) {
+      // Digests are only needed to persist values so they're skipped unless
+      // there is a store. Values are then volatile as if never digested.
+      uint64_t digest = 0;
+      bool is_volatile = true;
+      if (resources_.store()) {
+        std::vector<std::shared_ptr<ResourceGeneratorBase>> dep_gens;
+        for (const auto& pair : deps->deps()) {
+          dep_gens.push_back(pair.second);
+        }
+        std::tie(digest, is_volatile) = computeDigest(value, dep_gens);
+        update(version, *deps, value, digest, is_volatile);
+        if constexpr (IsPersistent<Resource>::value) {
+          if (!is_volatile) {
+            persist(value, digest, dep_gens);
+          }
+        }
+      } else {
+        update(version, *deps, value, digest, is_volatile);
+      }
+      auto finish = ProfileClock::now();
+      counters_.built(finish - start);
+      if (resources_.profiler()->isEnabled()) {
+        ResourceBuildEvent event{
+            typeid(Resource).name(), key_, thread, start, finish};
+        for (const auto& pair : deps->deps()) {
+          event.deps.push_back(pair.first);
+        }
+        profile(std::move(event));
+      }
+      return value;
+    });
+  }
+
+  Value wait(const AsyncResult<Value>& result);
+  void profile(ResourceBuildEvent event);
+  boost::optional<Value> restore(uint64_t version, ResourceDeps& deps);
+  void persist(
+      const Value& value,
+      uint64_t digest,
+      const std::vector<std::shared_ptr<ResourceGeneratorBase>>& dep_gens);
+
+  auto storeKey() {
+    return format("%1%/%2%", typeid(Resource).name(), *stableKey());
+  }
+
+  // Returns the digest of the value and whether it's unique to the process.
+  std::tuple<uint64_t, bool> computeDigest(
+      const Value& value,
+      const std::vector<std::shared_ptr<ResourceGeneratorBase>>& dep_gens) {
+    auto stable_key = stableKey();
+    if (!stable_key) {
+      return {stableHashCombine(key_, processDigestSeed()), true};
+    }
+    uint64_t ret = *stable_key;
+    if constexpr (HasDigest<Resource, Value>::value) {
+      return {stableHashCombine(ret, Resource::digest(value)), false};
+    } else if (dep_gens.empty()) {
+      return {stableHashCombine(ret, processDigestSeed()), true};
+    } else {
+      bool is_volatile = false;
+      std::vector<std::tuple<uint64_t, uint64_t>> dep_digests;
+      for (const auto& dep : dep_gens) {
+        auto dep_key = dep->stableKey();
+        dep_digests.emplace_back(dep_key.value_or(dep->key()), dep->digest());
+        is_volatile = is_volatile || !dep_key || dep->isVolatile();
+      }
+      std::sort(dep_digests.begin(), dep_digests.end());
+      for (const auto& [dep_key, dep_digest] : dep_digests) {
+        ret = stableHashCombine(stableHashCombine(ret, dep_key), dep_digest);
+      }
+      return {ret, is_volatile};
     }
   }
 
-  void cacheSubs() {
-    *cached_subs_ = subs_;
+  // Updates the value to the new version if its the latest and makes sure
+  // that dependency subscription lists match the latest version.
+  void update(
+      uint64_t version,
+      ResourceDeps& deps,
+      const Value& value,
+      uint64_t digest,
+      bool is_volatile) {
+    // We need to make sure that the old value isn't destroyed under the
+    // mutex otherwise we could deadlock. Swapping leaves it in new_value.
+    boost::optional<Value> new_value(value);
+    int64_t cpu_size = sizeOf(value);
+    int64_t gpu_size = gpuSizeOf(value);
+
+    std::lock_guard lock(mutex_);
+    if (version == requested_version_ && version > version_) {
+      value_.swap(new_value);
+      memory_->add(
+          new_value ? 0 : 1, cpu_size - cpu_size_, gpu_size - gpu_size_);
+      counters_.resized(cpu_size, gpu_size);
+      cpu_size_ = cpu_size;
+      gpu_size_ = gpu_size;
+      auto& new_deps = deps.deps();
+      for (const auto& pair : deps_) {
+        if (!new_deps.count(pair.first)) {
+          pair.second->unsubscribe(key_);
+        }
+      }
+      deps_.swap(new_deps);
+      digest_ = digest;
+      volatile_ = is_volatile;
+      version_ = version;
+    }
   }
 
   Resources& resources_;
   uint64_t key_;
+  ResourceKeys<Resource> keys_;
+  const Factory* factory_;
+  std::shared_ptr<ResourceMemoryCounters> memory_;
+  int64_t cpu_size_;
+  int64_t gpu_size_;
   std::atomic<uint64_t> version_;
   std::atomic<uint64_t> requested_version_;
-  std::shared_ptr<std::unordered_set<uint64_t>> cached_subs_;
-  std::shared_ptr<std::unordered_set<uint64_t>> cached_deps_;
-  std::function<Value()> generator_;
-  std::shared_ptr<Value> value_;
+  boost::optional<AsyncResult<Value>> building_;
+  uint64_t building_version_;
+  boost::optional<Value> value_;
   std::unordered_map<uint64_t, std::shared_ptr<ResourceGeneratorBase>> deps_;
-  std::unordered_set<uint64_t> subs_;
+  ResourceKeySet subs_;
   std::mutex generator_mutex_;
+  // Loaders are registered during static initialization so that persisted
+  // values can be validated before their dependencies are first requested.
+  static inline const bool kRegistered = [] {
+    if constexpr (kSerializableKeys<Resource>) {
+      return registerResourceLoader<Resource>();
+    } else {
+      return false;
+    }
+  }();
+
   std::shared_mutex mutex_;
+  ResourceCounters counters_;
+  uint64_t digest_;
+  bool volatile_;
 };
 
 // TODO: Implement cache eviction.
 // TODO: Implement hash collision fallback.
 class Resources {
  public:
-  Resources() : mutex_(std::make_unique<std::shared_mutex>()) {}
+  Resources()
+      : mutex_(std::make_unique<std::shared_mutex>()),
+        profiler_(std::make_shared<ResourceProfiler>()),
+        pool_(std::make_shared<BlockPool>()) {}
   Resources(std::unordered_map<std::type_index, boost::any> overrides)
       : mutex_(std::make_unique<std::shared_mutex>()),
+        profiler_(std::make_shared<ResourceProfiler>()),
+        pool_(std::make_shared<BlockPool>()),
         overrides_(std::move(overrides)) {}
 
   template <typename Resource, typename... Keys>
@@ -321,19 +799,137 @@ class Resources {
     return generator<Resource>(keys...)->get();
   }
 
+  template <typename Resource, typename... Keys>
+  auto getAsync(const Keys&... keys) {
+    return generator<Resource>(keys...)->getAsync();
+  }
+
+  // Returns the generator of the resource with the given type name and
+  // serialized keys or null if the type has no registered loader.
+  std::shared_ptr<ResourceGeneratorBase> generator(
+      const std::string& type, const std::string& keys);
+
+  // Sets the store used to persist values across runs (see IsPersistent).
+  // Digests are only computed while there is a store so it should be set
+  // before any resources are built.
+  void setStore(std::shared_ptr<ResourceStore> store) {
+    store_ = std::move(store);
+  }
+
+  const auto& store() {
+    return store_;
+  }
+
+  // Sets the executor used to build dependencies in parallel (see getAll).
+  void setExecutor(std::shared_ptr<WorkStealingExecutor> executor) {
+    executor_ = std::move(executor);
+  }
+
+  // Runs the function on the executor if there is an open one and otherwise
+  // on the calling thread.
+  template <typename Function>
+  auto schedule(Function fn) {
+    using Result = decltype(fn());
+    if (!executor_ || !executor_->isOpen()) {
+      return fn();
+    }
+    Result ret;
+    executor_->schedule([ret, fn = std::move(fn)] { fn().forward(ret); });
+    return ret;
+  }
+
+  // Waits on the result. Workers waiting on a build run the tasks it scheduled
+  // so that it can't starve (see WorkStealingExecutor::wait).
+  template <typename Value>
+  auto wait(const AsyncResult<Value>& result) {
+    return executor_ ? executor_->wait(result) : result.get();
+  }
+
   template <typename Resource, typename... Keys>
   void invalidate(const Keys&... keys) {
-    propagate(resourceHash<Resource>(keys...), [](auto generator) {
-      generator->clear();
-    });
+    invalidateMany({resourceHash<Resource>(keys...)});
+  }
+
+  // Invalidates the resource for each key. Generators affected through
+  // several of the keys are only cleared once.
+  template <typename Resource, typename Key>
+  void invalidateMany(const std::vector<Key>& keys) {
+    std::vector<uint64_t> resource_keys;
+    resource_keys.reserve(keys.size());
+    for (const auto& key : keys) {
+      resource_keys.push_back(resourceHash<Resource>(key));
+    }
+    invalidateMany(resource_keys);
+  }
+
+  // Invalidates the resources with the given hashes (see resourceHash) and
+  // their subscribers in a single propagation pass.
+  void invalidateMany(const std::vector<uint64_t>& resource_keys) {
+    auto gens = subscribers(resource_keys);
+    for (auto key : resource_keys) {
+      if (gens.count(key)) {
+        gens.at(key)->counters().invalidated(gens.size());
+      }
+    }
+    for (auto& pair : gens) {
+      pair.second->clear();
+    }
+  }
+
+  // Returns the timeline of resource builds (see ResourceProfiler::setEnabled).
+  const auto& profiler() {
+    return profiler_;
+  }
+
+  // Returns a snapshot of the profiling counters of every cached resource.
+  std::vector<ResourceProfile> profiles() {
+    std::shared_lock lock(*mutex_);
+    std::vector<ResourceProfile> ret;
+    ret.reserve(cache_.size());
+    for (const auto& pair : cache_) {
+      ret.push_back(pair.second->counters().profile());
+      ret.back().type = pair.second->type().name();
+      ret.back().key = pair.first;
+    }
+    return ret;
+  }
+
+  // Returns the memory held by cached values aggregated by resource type.
+  std::vector<ResourceMemory> memory() {
+    std::shared_lock lock(*mutex_);
+    std::vector<ResourceMemory> ret;
+    ret.reserve(memory_counters_.size());
+    for (const auto& pair : memory_counters_) {
+      ret.push_back(pair.second->memory());
+    }
+    return ret;
+  }
+
+  // Publishes the memory totals in megabytes, overall and by resource type.
+  void reportMemory(Stats& stats) {
+    constexpr float kMegabyte = 1024.0f * 1024.0f;
+    float cpu_total = 0.0f, gpu_total = 0.0f;
+    for (const auto& memory : this->memory()) {
+      float cpu_mb = memory.cpu_bytes / kMegabyte;
+      float gpu_mb = memory.gpu_bytes / kMegabyte;
+      stats.set(concat("resource_cpu_mb/", memory.type), cpu_mb);
+      if (memory.gpu_bytes) {
+        stats.set(concat("resource_gpu_mb/", memory.type), gpu_mb);
+      }
+      cpu_total += cpu_mb;
+      gpu_total += gpu_mb;
+    }
+    stats.set("resource_cpu_mb", cpu_total);
+    stats.set("resource_gpu_mb", gpu_total);
   }
 
  private:
   template <typename Resource>
   auto cachedGenerator(uint64_t cache_key) {
     std::shared_ptr<ResourceGenerator<Resource>> ret;
-    if (cache_.count(cache_key)) {
-      auto generator = cache_.at(cache_key);
+    auto it = cache_.find(cache_key);
+    if (it != cache_.end()) {
+      const auto& generator = it->second;
       ENFORCE(
           typeid(Resource) == generator->type(),
           concat(
@@ -346,16 +942,21 @@ class Resources {
     return ret;
   }
 
-  auto subscribers(uint64_t source_key) {
-    std::unordered_map<uint64_t, std::shared_ptr<ResourceGeneratorBase>> ret;
+  using GeneratorMap =
+      std::unordered_map<uint64_t, std::shared_ptr<ResourceGeneratorBase>>;
+
+  GeneratorMap subscribers(const std::vector<uint64_t>& source_keys) {
+    GeneratorMap ret;
 
-    // We need to propagate changes in dependency order.
-    std::unordered_set<uint64_t> done_keys;
-    std::vector<uint64_t> key_stack{source_key};
+    // We need to propagate changes in dependency order. Keys are marked done
+    // when pushed so each generator is visited once across all sources.
+    std::unordered_set<uint64_t> done_keys(
+        source_keys.begin(), source_keys.end());
+    std::vector<uint64_t> key_stack(done_keys.begin(), done_keys.end());
+    std::vector<uint64_t> subs;
     while (!key_stack.empty()) {
       auto key = key_stack.back();
       key_stack.pop_back();
-      done_keys.insert(key);
 
       // Get this generator from cache if it exists.
       auto generator = [&] {
@@ -370,8 +971,10 @@ class Resources {
       // Invalidate the generator and add its subs to the stack.
       if (generator) {
         ret[key] = generator;
-        for (auto sub : *generator->subscribers()) {
-          if (!done_keys.count(sub)) {
+        subs.clear();
+        generator->subscribers(subs);
+        for (auto sub : subs) {
+          if (done_keys.insert(sub).second) {
             key_stack.push_back(sub);
           }
         }
@@ -381,40 +984,211 @@ class Resources {
     return ret;
   }
 
-  template <typename Function>
-  void propagate(uint64_t source_key, Function&& fn) {
-    auto gens = subscribers(source_key);
-    for (auto& pair : gens) {
-      fn(pair.second);
-    }
-  }
-
+  // Generators are pooled since there may be hundreds of thousands of them.
+  // Overrides are referenced in place since they outlive the generators.
   template <typename Resource, typename... Keys>
   auto makeGenerator(const Keys&... keys) {
-    using Fun = decltype(make_function(&Resource::operator()));
     using Gen = ResourceGenerator<Resource>;
+    const typename Gen::Factory* factory = nullptr;
     auto it = overrides_.find(std::type_index(typeid(Resource)));
     if (it != overrides_.end()) {
-      auto fun = boost::any_cast<Fun>(it->second);
-      return std::make_shared<Gen>(*this, fun, keys...);
-    } else {
-      auto fun = [](auto&&... args) { return Resource()(args...); };
-      return std::make_shared<Gen>(*this, fun, keys...);
+      factory = boost::any_cast<typename Gen::Factory>(&it->second);
+      ENFORCE(factory);
+    }
+    auto& memory = memory_counters_[std::type_index(typeid(Resource))];
+    if (!memory) {
+      memory =
+          std::make_shared<ResourceMemoryCounters>(typeid(Resource).name());
     }
+    return std::allocate_shared<Gen>(
+        PoolAllocator<Gen>(pool_), *this, factory, memory, keys...);
   }
 
   std::unique_ptr<std::shared_mutex> mutex_;
+  std::shared_ptr<ResourceProfiler> profiler_;
+  std::shared_ptr<BlockPool> pool_;
   std::unordered_map<std::type_index, boost::any> overrides_;
   std::unordered_map<uint64_t, std::shared_ptr<ResourceGeneratorBase>> cache_;
+  std::unordered_map<std::type_index, std::shared_ptr<ResourceMemoryCounters>>
+      memory_counters_;
+  std::shared_ptr<WorkStealingExecutor> executor_;
+  std::shared_ptr<ResourceStore> store_;
 };
 
+using ResourceLoader = std::function<std::shared_ptr<ResourceGeneratorBase>(
+    Resources&, const std::string&)>;
+
+// Maps resource type names to loaders regenerating them from serialized keys.
+struct ResourceLoaders {
+  std::mutex mutex;
+  std::unordered_map<std::string, ResourceLoader> loaders;
+};
+
+inline ResourceLoaders& resourceLoaders() {
+  static ResourceLoaders ret;
+  return ret;
+}
+
+template <typename Resource>
+bool registerResourceLoader() {
+  auto& registry = resourceLoaders();
+  std::lock_guard lock(registry.mutex);
+  registry.loaders[typeid(Resource).name()] = [](Resources& resources,
+                                                 const std::string& keys) {
+    return std::apply(
+        [&](const auto&... keys) -> std::shared_ptr<ResourceGeneratorBase> {
+          return resources.generator<Resource>(keys...);
+        },
+        deserialize<ResourceKeys<Resource>>(keys));
+  };
+  return true;
+}
+
+inline std::shared_ptr<ResourceGeneratorBase> Resources::generator(
+    const std::string& type, const std::string& keys) {
+  ResourceLoader loader;
+  {
+    auto& registry = resourceLoaders();
+    std::lock_guard lock(registry.mutex);
+    auto it = registry.loaders.find(type);
+    if (it == registry.loaders.end()) {
+      return nullptr;
+    }
+    loader = it->second;
+  }
+  return loader(*this, keys);
+}
+
+template <typename Resource>
+auto ResourceGenerator<Resource>::wait(const AsyncResult<Value>& result)
+    -> Value {
+  return resources_.wait(result);
+}
+
+template <typename Resource>
+void ResourceGenerator<Resource>::profile(ResourceBuildEvent event) {
+  resources_.profiler()->record(std::move(event));
+}
+
+template <typename Resource>
+auto ResourceGenerator<Resource>::restore(uint64_t version, ResourceDeps& deps)
+    -> boost::optional<Value> {
+  auto store = resources_.store();
+  if (!store) {
+    return boost::none;
+  }
+  try {
+    auto data = store->load(storeKey());
+    if (!data) {
+      return boost::none;
+    }
+    auto persisted = deserialize<PersistedResource>(*data);
+    if (persisted.keys != *serializedKeys()) {
+      return boost::none;
+    }
+
+    // The value is only valid if all of its dependencies are unchanged.
+    std::vector<std::shared_ptr<ResourceGeneratorBase>> dep_gens;
+    for (const auto& dep : persisted.deps) {
+      auto generator = resources_.generator(dep.type, dep.keys);
+      if (!generator) {
+        return boost::none;
+      }
+      generator->refresh();
+      if (generator->isVolatile() || generator->digest() != dep.digest) {
+        return boost::none;
+      }
+      dep_gens.push_back(generator);
+    }
+
+    // Subscribe to the dependencies as if the value were just built.
+    for (const auto& generator : dep_gens) {
+      generator->subscribe(key_);
+      deps.deps().emplace(generator->key(), generator);
+    }
+    auto value = deserializeValue<Value>(persisted.value);
+    update(version, deps, value, persisted.digest, false);
+    return value;
+  } catch (const std::exception& e) {
+    LOG_ERROR(format(
+        "Unable to restore resource \"%1%\": %2%",
+        typeid(Resource).name(),
+        e.what()));
+    return boost::none;
+  }
+}
+
+template <typename Resource>
+void ResourceGenerator<Resource>::persist(
+    const Value& value,
+    uint64_t digest,
+    const std::vector<std::shared_ptr<ResourceGeneratorBase>>& dep_gens) {
+  auto store = resources_.store();
+  if (!store) {
+    return;
+  }
+  if constexpr (IsSharedPtr<Value>::value) {
+    if (!value) {
+      return;
+    }
+  }
+  PersistedResource persisted{*serializedKeys(), digest};
+  for (const auto& generator : dep_gens) {
+    auto keys = generator->serializedKeys();
+    if (!keys) {
+      return;
+    }
+    persisted.deps.push_back(PersistedDependency{
+        generator->type().name(), std::move(*keys), generator->digest()});
+  }
+  try {
+    persisted.value = serializeValue(value);
+    store->save(storeKey(), serialize(persisted));
+  } catch (const std::exception& e) {
+    LOG_ERROR(format(
+        "Unable to persist resource \"%1%\": %2%",
+        typeid(Resource).name(),
+        e.what()));
+  }
+}
+
+template <typename Resource, typename... Keys>
+auto ResourceDeps::subscribe(const Keys&... keys) {
+  auto generator = resources_.generator<Resource>(keys...);
+  generator->subscribe(resource_key_);
+  std::lock_guard lock(mutex_);
+  deps_.emplace(resourceHash<Resource>(keys...), generator);
+  return generator;
+}
+
+template <typename Resource, typename... Keys>
+AsyncResult<ResourceValue<Resource>> ResourceDeps::getAsync(
+    const Keys&... keys) {
+  return subscribe<Resource>(keys...)->getAsync();
+}
+
+template <typename Resource, typename Key>
+AsyncResult<std::vector<ResourceValue<Resource>>> ResourceDeps::getAll(
+    const std::vector<Key>& keys) {
+  // Build all but the last missing value on the executor and the last one on
+  // this thread so that it isn't left idle.
+  std::vector<AsyncResult<ResourceValue<Resource>>> results;
+  for (size_t i = 0; i < keys.size(); i += 1) {
+    auto generator = subscribe<Resource>(keys[i]);
+    if (generator->fresh() || i + 1 == keys.size()) {
+      results.push_back(generator->getAsync());
+    } else {
+      results.push_back(
+          resources_.schedule([generator] { return generator->getAsync(); }));
+    }
+  }
+  return whenAll(std::move(results));
+}
+
 template <typename Resource, typename... Keys>
 ResourceValue<Resource> ResourceDeps::get(const Keys&... keys) {
   try {
-    auto generator = resources_.generator<Resource>(keys...);
-    generator->subscribe(resource_key_);
-    deps_.emplace(resourceHash<Resource>(keys...), generator);
-    return generator->get();
+    return subscribe<Resource>(keys...)->get();
   } catch (const std::exception& e) {
     LOG_ERROR(format(
         "Resource \"%1%\" exception: %2%", typeid(Resource).name(), e.what()));
@@ -429,19 +1203,23 @@ class AsyncResources {
  public:
   AsyncResources(
       std::shared_ptr<Resources> resources,
-      std::shared_ptr<QueueExecutor> executor)
-      : resources_(std::move(resources)), executor_(std::move(executor)) {}
+      std::shared_ptr<WorkStealingExecutor> executor)
+      : resources_(std::move(resources)), executor_(std::move(executor)) {
+    resources_->setExecutor(executor_);
+  }
 
   std::shared_ptr<Resources> resources() {
     return resources_;
   }
 
+  // Builds the resource on the executor. Asynchronous resource factories
+  // release the worker while they wait (e.g. on the OpenGL thread).
   template <typename Resource, typename... Keys>
   auto get(const Keys&... keys) {
-    return schedule(
+    return scheduleAsync(
         concat("get", describe<Resource>(keys...)),
         [this](const auto&... keys) {
-          return resources()->get<Resource>(keys...);
+          return resources()->getAsync<Resource>(keys...);
         },
         keys...);
   }
@@ -451,11 +1229,8 @@ class AsyncResources {
   // the cache or if one exists but it is stale.
   template <typename Resource, typename... Keys>
   auto optGet(const Keys&... keys) {
-    boost::optional<ResourceValue<Resource>> ret;
     auto generator = resources()->generator<Resource>(keys...);
-    if (auto value_ptr = generator->get_ptr()) {
-      ret = *value_ptr;
-    }
+    auto ret = generator->cachedValue();
     if (generator->stale()) {
       get<Resource>(keys...);
     }
@@ -489,6 +1264,8 @@ class AsyncResources {
         keys...);
   }
 
+  std::future<void> invalidateMany(const std::vector<uint64_t>& resource_keys);
+
  private:
   template <typename Resource, typename... Keys>
   auto describe(const Keys&... keys) {
@@ -509,10 +1286,49 @@ class AsyncResources {
         });
   }
 
+  template <typename Function, typename... Keys>
+  auto scheduleAsync(
+      const std::string& task, Function fn, const Keys&... keys) {
+    using Result = decltype(fn(keys...));
+    using Value = typename Result::value_type;
+    auto promise = std::make_shared<std::promise<Value>>();
+    auto ret = promise->get_future();
+    executor_->schedule([task,
+                         promise,
+                         fn = std::move(fn),
+                         keys = std::make_tuple(keys...)] {
+      auto on_ready = [task, promise](const Result& result) {
+        try {
+          promise->set_value(result.get());
+        } catch (const std::exception& e) {
+          LOG_ERROR(
+              format("Async resource error:  %1%. Task: %2%", e.what(), task));
+          promise->set_exception(std::current_exception());
+        }
+      };
+      try {
+        std::apply(fn, keys).onReady(std::move(on_ready));
+      } catch (...) {
+        promise->set_exception(std::current_exception());
+      }
+    });
+    return ret;
+  }
+
   std::shared_ptr<Resources> resources_;
-  std::shared_ptr<QueueExecutor> executor_;
+  std::shared_ptr<WorkStealingExecutor> executor_;
 };  // namespace tequila
 
+inline std::future<void> AsyncResources::invalidateMany(
+    const std::vector<uint64_t>& resource_keys) {
+  return schedule(
+      "invalidateMany",
+      [this](const auto& resource_keys) {
+        return resources()->invalidateMany(resource_keys);
+      },
+      resource_keys);
+}
+
 class ResourcesBuilder {
  public:
   template <typename Resource, typename FunctionType>
@@ -526,6 +1342,12 @@ class ResourcesBuilder {
     return *this;
   }
 
+  // Persists values of resources opting in (see IsPersistent) in the store.
+  ResourcesBuilder& withStore(std::shared_ptr<ResourceStore> store) {
+    store_ = std::move(store);
+    return *this;
+  }
+
   template <typename Resource, typename ValueType>
   ResourcesBuilder& withSeed(ValueType&& value) {
     decltype(make_function(Resource())) fn =
@@ -539,11 +1361,14 @@ class ResourcesBuilder {
   }
 
   Resources build() {
-    return Resources(std::move(overrides_));
+    Resources ret(std::move(overrides_));
+    ret.setStore(std::move(store_));
+    return ret;
   }
 
  private:
   std::unordered_map<std::type_index, boost::any> overrides_;
+  std::shared_ptr<ResourceStore> store_;
 };
 
 template <typename Resource, typename Value>
@@ -558,15 +1383,15 @@ class ResourceMutation {
  public:
   ResourceMutation(Resources& resources, const Keys&... keys)
       : value_(resources.get<Resource>(keys...)) {
-    invalidator_ = [&resources, keys...] {
-      resources.invalidate<Resource>(keys...);
+    invalidator_ = [&resources, key = resourceHash<Resource>(keys...)] {
+      resources.invalidateMany({key});
     };
   }
 
   ResourceMutation(AsyncResources& resources, const Keys&... keys)
       : value_(resources.get<Resource>(keys...).get()) {
-    invalidator_ = [&resources, keys...] {
-      resources.invalidate<Resource>(keys...);
+    invalidator_ = [&resources, key = resourceHash<Resource>(keys...)] {
+      resources.invalidateMany({key});
     };
   }
 
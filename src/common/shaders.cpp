@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "src/common/errors.hpp"
+#include "src/common/glstate.hpp"
 #include "src/common/opengl.hpp"
 #include "src/common/shaders.hpp"
 
@@ -45,7 +46,50 @@ ShaderProgram::ShaderProgram(const std::vector<ShaderSource>& sources) {
   for (const auto shader : shaders) {
     glAttachShader(program_, shader);
   }
+  for (size_t i = 0; i < kVertexAttributeNames.size(); i += 1) {
+    glBindAttribLocation(program_, i, kVertexAttributeNames[i]);
+  }
   glLinkProgram(program_);
+  GLint link_status = 0;
+  glGetProgramiv(program_, GL_LINK_STATUS, &link_status);
+  ENFORCE(link_status, "Unable to link shader program.");
+  cacheLocations();
+}
+
+void ShaderProgram::cacheLocations() {
+  constexpr auto kBufferSize = 256;
+  GLint size, count;
+  GLenum type;
+  GLsizei name_size;
+  GLchar name[kBufferSize];
+
+  // Arrays are reported by the name of their first element (e.g. "a[0]") so
+  // we also cache them by their plain name.
+  auto cache = [&](auto& locations, int location) {
+    std::string key(name, name_size);
+    locations[key] = location;
+    if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+      locations[key.substr(0, key.size() - 3)] = location;
+    }
+  };
+  glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &count);
+  for (GLint i = 0; i < count; i += 1) {
+    glGetActiveUniform(
+        program_, i, kBufferSize, &name_size, &size, &type, name);
+    auto location = glGetUniformLocation(program_, name);
+    if (location != -1) {
+      cache(uniforms_, location);
+    }
+  }
+  glGetProgramiv(program_, GL_ACTIVE_ATTRIBUTES, &count);
+  for (GLint i = 0; i < count; i += 1) {
+    glGetActiveAttrib(
+        program_, i, kBufferSize, &name_size, &size, &type, name);
+    auto location = glGetAttribLocation(program_, name);
+    if (location != -1) {
+      cache(attributes_, location);
+    }
+  }
 }
 
 ShaderProgram::~ShaderProgram() {
@@ -58,15 +102,17 @@ ShaderProgram::ShaderProgram(ShaderProgram&& other) : program_(0) {
 
 ShaderProgram& ShaderProgram::operator=(ShaderProgram&& other) {
   std::swap(program_, other.program_);
+  std::swap(uniforms_, other.uniforms_);
+  std::swap(attributes_, other.attributes_);
   return *this;
 }
 
 void ShaderProgram::run(std::function<void()> fn) {
   try {
-    glUseProgram(program_);
+    glState().useProgram(program_);
     fn();
   } catch (...) {
-    glUseProgram(0);
+    glState().useProgram(0);
     throw;
   }
 }
@@ -103,28 +149,73 @@ void ShaderProgram::uniform(const std::string& name, const glm::mat4& value) {
   glUniformMatrix4fv(uniform(name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
+void ShaderProgram::uniform(ShaderUniform<bool> handle, bool value) {
+  glUniform1i(handle.location(), value);
+}
+
+void ShaderProgram::uniform(ShaderUniform<int> handle, int value) {
+  glUniform1i(handle.location(), value);
+}
+
+void ShaderProgram::uniform(ShaderUniform<float> handle, float value) {
+  glUniform1f(handle.location(), value);
+}
+
+void ShaderProgram::uniform(
+    ShaderUniform<glm::vec2> handle, const glm::vec2& value) {
+  glUniform2fv(handle.location(), 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::uniform(
+    ShaderUniform<glm::vec3> handle, const glm::vec3& value) {
+  glUniform3fv(handle.location(), 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::uniform(
+    ShaderUniform<glm::vec4> handle, const glm::vec4& value) {
+  glUniform4fv(handle.location(), 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::uniform(
+    ShaderUniform<glm::mat3> handle, const glm::mat3& value) {
+  glUniformMatrix3fv(handle.location(), 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void ShaderProgram::uniform(
+    ShaderUniform<glm::mat4> handle, const glm::mat4& value) {
+  glUniformMatrix4fv(handle.location(), 1, GL_FALSE, glm::value_ptr(value));
+}
+
 int ShaderProgram::uniform(const std::string& name) const {
-  auto ret = glGetUniformLocation(program_, name.c_str());
-  if (ret == -1) {
+  auto it = uniforms_.find(name);
+  if (it == uniforms_.end()) {
     throwError("Invalid shader uniform: %1%", name);
   }
-  return ret;
+  return it->second;
 }
 
 int ShaderProgram::attribute(const std::string& name) const {
-  auto ret = glGetAttribLocation(program_, name.c_str());
-  if (ret == -1) {
+  auto it = attributes_.find(name);
+  if (it == attributes_.end()) {
     throwError("Invalid shader attribute: %1%", name);
   }
-  return ret;
+  return it->second;
+}
+
+void ShaderProgram::uniformBlock(const std::string& name, unsigned binding) {
+  auto index = glGetUniformBlockIndex(program_, name.c_str());
+  if (index == GL_INVALID_INDEX) {
+    throwError("Invalid shader uniform block: %1%", name);
+  }
+  glUniformBlockBinding(program_, index, binding);
 }
 
 bool ShaderProgram::hasUniform(const std::string& name) const {
-  return glGetUniformLocation(program_, name.c_str()) != -1;
+  return uniforms_.count(name);
 }
 
 bool ShaderProgram::hasAttribute(const std::string& name) const {
-  return glGetAttribLocation(program_, name.c_str()) != -1;
+  return attributes_.count(name);
 }
 
 void ShaderProgram::printDebugInfo() const {
@@ -143,4 +234,38 @@ void ShaderProgram::printDebugInfo() const {
   }
 }
 
+UniformBuffer::UniformBuffer(size_t size) : buffer_(0), size_(size) {
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+  glBufferData(GL_UNIFORM_BUFFER, size_, nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer() {
+  if (buffer_) {
+    glDeleteBuffers(1, &buffer_);
+  }
+}
+
+UniformBuffer::UniformBuffer(UniformBuffer&& other) : buffer_(0), size_(0) {
+  *this = std::move(other);
+}
+
+UniformBuffer& UniformBuffer::operator=(UniformBuffer&& other) {
+  std::swap(buffer_, other.buffer_);
+  std::swap(size_, other.size_);
+  return *this;
+}
+
+void UniformBuffer::update(const void* data, size_t size) {
+  ENFORCE(size <= size_);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind(unsigned binding) const {
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer_);
+}
+
 }  // namespace tequila
\ No newline at end of file
@@ -2,10 +2,13 @@
 
 #include <glm/glm.hpp>
 
+#include <array>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "src/common/errors.hpp"
 #include "src/common/opengl.hpp"
 #include "src/common/registry.hpp"
 
@@ -28,6 +31,70 @@ inline auto makeFragmentShader(StringType&& code) {
   return ShaderSource(gl::GL_FRAGMENT_SHADER, std::forward<StringType>(code));
 }
 
+// Vertex attributes are bound to standard locations (their index here) before
+// shaders are linked so that vertex arrays can be configured once for use with
+// any shader.
+constexpr std::array<const char*, 5> kVertexAttributeNames = {
+    "position",
+    "normal",
+    "tangent",
+    "color",
+    "tex_coord",
+};
+
+// Returns the standard location of a vertex attribute.
+inline int vertexAttributeLocation(const std::string& name) {
+  for (size_t i = 0; i < kVertexAttributeNames.size(); i += 1) {
+    if (name == kVertexAttributeNames[i]) {
+      return i;
+    }
+  }
+  throwError("Invalid vertex attribute: %1%", name);
+}
+
+// A uniform location resolved ahead of time. Handles are typed so that values
+// are uploaded with the matching glUniform call without a name lookup.
+template <typename Value>
+class ShaderUniform {
+ public:
+  explicit ShaderUniform(int location) : location_(location) {}
+
+  int location() const {
+    return location_;
+  }
+
+ private:
+  int location_;
+};
+
+// A buffer of uniform values shared by shaders (e.g. per frame camera and
+// light state) which is uploaded once and bound to a uniform block binding
+// point. Values must follow the std140 layout of the block.
+class UniformBuffer {
+ public:
+  UniformBuffer(size_t size);
+  ~UniformBuffer();
+
+  UniformBuffer(UniformBuffer&& other);
+  UniformBuffer& operator=(UniformBuffer&& other);
+
+  UniformBuffer(const UniformBuffer&) = delete;
+  UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+  template <typename Value>
+  void update(const Value& value) {
+    update(&value, sizeof(Value));
+  }
+  void update(const void* data, size_t size);
+
+  // Binds the buffer to the uniform block binding point.
+  void bind(unsigned binding) const;
+
+ private:
+  gl::GLuint buffer_;
+  size_t size_;
+};
+
 class ShaderProgram {
  public:
   ShaderProgram(const std::vector<ShaderSource>& sources);
@@ -54,10 +121,29 @@ class ShaderProgram {
   void uniform(const std::string& name, const glm::mat3& value);
   void uniform(const std::string& name, const glm::mat4& value);
 
-  // Methods to access uniform and attribute locations.
+  // Methods to specify uniform variables through handles.
+  void uniform(ShaderUniform<bool> handle, bool value);
+  void uniform(ShaderUniform<int> handle, int value);
+  void uniform(ShaderUniform<float> handle, float value);
+  void uniform(ShaderUniform<glm::vec2> handle, const glm::vec2& value);
+  void uniform(ShaderUniform<glm::vec3> handle, const glm::vec3& value);
+  void uniform(ShaderUniform<glm::vec4> handle, const glm::vec4& value);
+  void uniform(ShaderUniform<glm::mat3> handle, const glm::mat3& value);
+  void uniform(ShaderUniform<glm::mat4> handle, const glm::mat4& value);
+
+  // Methods to access uniform and attribute locations. Locations are cached
+  // when the program is linked.
   int uniform(const std::string& name) const;
   int attribute(const std::string& name) const;
 
+  template <typename Value>
+  ShaderUniform<Value> uniformHandle(const std::string& name) const {
+    return ShaderUniform<Value>(uniform(name));
+  }
+
+  // Assigns a uniform block to a binding point (see UniformBuffer).
+  void uniformBlock(const std::string& name, unsigned binding);
+
   // Methods to conditionally check for shader state.
   bool hasUniform(const std::string& name) const;
   bool hasAttribute(const std::string& name) const;
@@ -65,7 +151,11 @@ class ShaderProgram {
   void printDebugInfo() const;
 
  private:
+  void cacheLocations();
+
   gl::GLint program_;
+  std::unordered_map<std::string, int> uniforms_;
+  std::unordered_map<std::string, int> attributes_;
 };
 
 }  // namespace tequila
\ No newline at end of file
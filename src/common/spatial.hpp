@@ -5,10 +5,16 @@
 #include <cereal/types/utility.hpp>
 #include <cereal/types/vector.hpp>
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -73,6 +79,13 @@ class CompactVector {
     }
   }
 
+  // Returns the number of bytes of host memory owned by this vector.
+  size_t cpuBytes() const {
+    using Pair = std::pair<int, ValueType>;
+    return sizeof(*this) +
+        (ranges_.capacity() + buffer_.capacity()) * sizeof(Pair);
+  }
+
   template <typename Archive>
   void save(Archive& archive) const {
     archive(ranges_, buffer_);
@@ -154,14 +167,14 @@ class SquareStore {
   }
 
   void set(int x, int y, ValueType value) {
-    ENFORCE(0 <= x && x < size_);
-    ENFORCE(0 <= y && y < size_);
+    ENFORCE(0 <= x && x < static_cast<int>(size_));
+    ENFORCE(0 <= y && y < static_cast<int>(size_));
     cv_.set(toIndex(x, y), std::move(value));
   }
 
   ValueType get(int x, int y) const {
-    ENFORCE(0 <= x && x < size_);
-    ENFORCE(0 <= y && y < size_);
+    ENFORCE(0 <= x && x < static_cast<int>(size_));
+    ENFORCE(0 <= y && y < static_cast<int>(size_));
     return cv_.get(toIndex(x, y));
   }
 
@@ -208,16 +221,16 @@ class CubeStore {
   }
 
   void set(int x, int y, int z, ValueType value) {
-    ENFORCE(0 <= x && x < size_, format("x=%1%", x));
-    ENFORCE(0 <= y && y < size_, format("y=%1%", y));
-    ENFORCE(0 <= z && z < size_, format("z=%1%", z));
+    ENFORCE(0 <= x && x < static_cast<int>(size_), format("x=%1%", x));
+    ENFORCE(0 <= y && y < static_cast<int>(size_), format("y=%1%", y));
+    ENFORCE(0 <= z && z < static_cast<int>(size_), format("z=%1%", z));
     cv_.set(toIndex(x, y, z), std::move(value));
   }
 
   ValueType get(int x, int y, int z) const {
-    ENFORCE(0 <= x && x < size_);
-    ENFORCE(0 <= y && y < size_);
-    ENFORCE(0 <= z && z < size_);
+    ENFORCE(0 <= x && x < static_cast<int>(size_));
+    ENFORCE(0 <= y && y < static_cast<int>(size_));
+    ENFORCE(0 <= z && z < static_cast<int>(size_));
     return cv_.get(toIndex(x, y, z));
   }
 
@@ -237,6 +250,10 @@ class CubeStore {
     return size_;
   }
 
+  size_t cpuBytes() const {
+    return sizeof(size_) + cv_.cpuBytes();
+  }
+
   template <typename Function>
   void forRanges(Function&& fn) {
     cv_.forRanges([&](auto value, int i, int n) {
@@ -265,6 +282,9 @@ class Octree {
  public:
   using BoxTuple = std::tuple<int, int, int, int, int, int>;
 
+  // Grid sizes are below 2**20 so that trees are at most 21 levels deep.
+  static constexpr int kMaxTreeDepth = 21;
+
   Octree(size_t leaf_size, size_t grid_size)
       : leaf_size_(leaf_size), grid_size_(grid_size) {
     ENFORCE(leaf_size);
@@ -296,24 +316,29 @@ class Octree {
     return (cell - 1) / 8;
   }
 
+  // Visits cells depth first, descending into the children of each cell for
+  // which cell_fn returns true. The traversal stack lives on the call stack
+  // since each level holds at most seven pending siblings.
   template <typename CellFunction>
   auto search(CellFunction cell_fn, int64_t root_cell = 0) const {
-    ENFORCE(0 <= root_cell && root_cell < cellCount());
-    std::vector<int64_t> stack{root_cell};
-    while (stack.size()) {
-      auto cell = stack.back();
-      stack.pop_back();
-      if (cell_fn(cell) && 8 * cell + 1 < cellCount()) {
+    ENFORCE(0 <= root_cell && root_cell < static_cast<int64_t>(cellCount()));
+    std::array<int64_t, 7 * kMaxTreeDepth + 1> stack;
+    int size = 0;
+    stack[size++] = root_cell;
+    while (size) {
+      auto cell = stack[--size];
+      if (cell_fn(cell) && 8 * cell + 1 < static_cast<int64_t>(cellCount())) {
         for (int i = 0; i < 8; i += 1) {
-          stack.push_back(8 * cell + 1 + i);
+          stack[size++] = 8 * cell + 1 + i;
         }
       }
     }
   }
 
-  // Returns the octree cell IDs intersecting the given bounding box.
-  auto intersectBox(const BoxTuple& box) const {
-    std::vector<int64_t> ret;
+  // Calls visit(cell) for each octree cell intersecting the given bounding
+  // box. Descendants of a cell are visited only if the cell intersects.
+  template <typename Visitor>
+  void intersectBox(const BoxTuple& box, Visitor visit) const {
     search([&](int64_t cell) {
       auto tbox = cellBox(cell);
       auto xq = std::get<3>(box) - std::get<0>(tbox) - 1;
@@ -323,25 +348,87 @@ class Octree {
       auto zq = std::get<5>(box) - std::get<2>(tbox) - 1;
       auto zt = std::get<5>(tbox) - std::get<2>(box) - 1;
       if ((xq ^ xt) >= 0 && (yq ^ yt) >= 0 && (zq ^ zt) >= 0) {
-        ret.push_back(cell);
+        visit(cell);
         return true;
       }
       return false;
     });
+  }
+
+  // Returns the octree cell IDs intersecting the given bounding box.
+  std::vector<int64_t> intersectBox(const BoxTuple& box) const {
+    std::vector<int64_t> ret;
+    intersectBox(box, [&](int64_t cell) { ret.push_back(cell); });
     return ret;
   }
 
+  // Calls visit(cell, t) for each cell intersecting the ray from the origin
+  // along the direction, where t is the ray parameter at which it enters the
+  // cell. Only cells entered within max_t are visited.
+  template <typename Visitor>
+  void intersectRay(
+      const std::array<float, 3>& origin,
+      const std::array<float, 3>& direction,
+      float max_t,
+      Visitor visit) const {
+    std::array<float, 3> inv_dir;
+    for (int i = 0; i < 3; i += 1) {
+      inv_dir[i] = 1.0f / direction[i];
+    }
+    search([&](int64_t cell) {
+      auto [x0, y0, z0, x1, y1, z1] = cellBox(cell);
+      std::array<float, 3> lo{float(x0), float(y0), float(z0)};
+      std::array<float, 3> hi{float(x1), float(y1), float(z1)};
+      float t0 = 0.0f, t1 = max_t;
+      for (int i = 0; i < 3; i += 1) {
+        float ta = (lo[i] - origin[i]) * inv_dir[i];
+        float tb = (hi[i] - origin[i]) * inv_dir[i];
+        if (std::isnan(ta) || std::isnan(tb)) {
+          // The ray runs along one of the cell's faces.
+          continue;
+        }
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+      }
+      if (t0 > t1) {
+        return false;
+      }
+      visit(cell, t0);
+      return true;
+    });
+  }
+
+  // Calls visit(cell) for each cell intersecting the given sphere.
+  template <typename Visitor>
+  void intersectSphere(
+      const std::array<float, 3>& center, float radius, Visitor visit) const {
+    search([&](int64_t cell) {
+      auto [x0, y0, z0, x1, y1, z1] = cellBox(cell);
+      auto axis_distance = [](float c, float lo, float hi) {
+        return c < lo ? lo - c : (c > hi ? c - hi : 0.0f);
+      };
+      auto dx = axis_distance(center[0], x0, x1);
+      auto dy = axis_distance(center[1], y0, y1);
+      auto dz = axis_distance(center[2], z0, z1);
+      if (dx * dx + dy * dy + dz * dz > radius * radius) {
+        return false;
+      }
+      visit(cell);
+      return true;
+    });
+  }
+
+  // Returns the cell on the given level containing the given point.
+  int64_t cellAt(int level, int x, int y, int z) const {
+    int cell_size = (grid_size_ * leaf_size_) >> level;
+    return kLevelOffsets[level] +
+        encodeMorton(x / cell_size, y / cell_size, z / cell_size);
+  }
+
   // Returns a bounding box (in coordinate-pair format) for the given cell.
   BoxTuple cellBox(int64_t cell) const {
     int level = cellLevel(cell);
-    int64_t ic = cell - ((1 << 3 * level) - 1) / 7;
-    int ix = 0, iy = 0, iz = 0;
-    for (int shift = 0; shift < level; shift += 1) {
-      ix += (0b1 & ic) << shift;
-      iy += (0b1 & (ic >> 1)) << shift;
-      iz += (0b1 & (ic >> 2)) << shift;
-      ic >>= 3;
-    }
+    auto [ix, iy, iz] = decodeMorton(cell - kLevelOffsets[level]);
     int cell_size = (grid_size_ * leaf_size_) >> level;
     return std::make_tuple(
         ix * cell_size,
@@ -353,10 +440,122 @@ class Octree {
   }
 
  private:
+  // The ID of the first cell on each level.
+  static constexpr auto kLevelOffsets = [] {
+    std::array<int64_t, kMaxTreeDepth + 1> ret{};
+    for (int level = 0; level <= kMaxTreeDepth; level += 1) {
+      ret[level] = ((uint64_t(1) << 3 * level) - 1) / 7;
+    }
+    return ret;
+  }();
+
+  // Bits of the x coordinate in a cell's index within its level. Those of the
+  // y and z coordinates follow in the next bits.
+  static constexpr uint64_t kMortonMask = 0x1249249249249249;
+
+  static int64_t encodeMorton(int ix, int iy, int iz) {
+#if defined(__BMI2__)
+    return _pdep_u64(ix, kMortonMask) | _pdep_u64(iy, kMortonMask << 1) |
+        _pdep_u64(iz, kMortonMask << 2);
+#else
+    int64_t ret = 0;
+    for (int shift = 0; (ix | iy | iz) >> shift; shift += 1) {
+      ret |= static_cast<int64_t>(0b1 & (ix >> shift)) << 3 * shift;
+      ret |= static_cast<int64_t>(0b1 & (iy >> shift)) << (3 * shift + 1);
+      ret |= static_cast<int64_t>(0b1 & (iz >> shift)) << (3 * shift + 2);
+    }
+    return ret;
+#endif
+  }
+
+  static std::tuple<int, int, int> decodeMorton(int64_t ic) {
+#if defined(__BMI2__)
+    return {
+        static_cast<int>(_pext_u64(ic, kMortonMask)),
+        static_cast<int>(_pext_u64(ic, kMortonMask << 1)),
+        static_cast<int>(_pext_u64(ic, kMortonMask << 2))};
+#else
+    int ix = 0, iy = 0, iz = 0;
+    for (int shift = 0; ic; shift += 1) {
+      ix += (0b1 & ic) << shift;
+      iy += (0b1 & (ic >> 1)) << shift;
+      iz += (0b1 & (ic >> 2)) << shift;
+      ic >>= 3;
+    }
+    return {ix, iy, iz};
+#endif
+  }
+
   size_t leaf_size_;
   size_t grid_size_;
   size_t tree_depth_;
   size_t cell_count_;
 };
 
+enum class Occupancy : uint8_t { EMPTY, MIXED, FULL };
+
+// Summarizes whether octree cells are empty, full or a mix of both so that
+// searches may skip empty space. Summaries are kept for all cells down to the
+// given level and deeper cells share the summary of their ancestor on it.
+class OctreeOccupancy {
+ public:
+  OctreeOccupancy() : level_(0) {}
+
+  OctreeOccupancy(const Octree& octree, int level)
+      : level_(level),
+        cells_(levelEnd(level), static_cast<uint8_t>(Occupancy::MIXED)) {
+    ENFORCE(0 <= level && level < static_cast<int>(octree.treeDepth()));
+  }
+
+  auto level() const {
+    return level_;
+  }
+
+  Occupancy get(int64_t cell) const {
+    for (; cell >= static_cast<int64_t>(cells_.size()); cell = (cell - 1) / 8) {
+    }
+    return static_cast<Occupancy>(cells_.at(cell));
+  }
+
+  // Sets the occupancy of a cell on the deepest summarized level and updates
+  // its ancestors. Returns whether the summary changed.
+  bool set(int64_t cell, Occupancy occupancy) {
+    ENFORCE(levelEnd(level_ - 1) <= cell && cell < levelEnd(level_));
+    auto value = static_cast<uint8_t>(occupancy);
+    if (cells_[cell] == value) {
+      return false;
+    }
+    cells_[cell] = value;
+    while (cell > 0) {
+      cell = (cell - 1) / 8;
+      auto first = cells_[8 * cell + 1];
+      auto parent = first;
+      for (int i = 1; i < 8; i += 1) {
+        if (cells_[8 * cell + 1 + i] != first) {
+          parent = static_cast<uint8_t>(Occupancy::MIXED);
+        }
+      }
+      if (cells_[cell] == parent) {
+        break;
+      }
+      cells_[cell] = parent;
+    }
+    return true;
+  }
+
+  template <typename Archive>
+  void serialize(Archive& archive) {
+    archive(level_, cells_);
+  }
+
+ private:
+  // Returns the number of cells on all levels up to the given level.
+  static int64_t levelEnd(int level) {
+    return ((int64_t(1) << 3 * (level + 1)) - 1) / 7;
+  }
+
+  int level_;
+  std::vector<uint8_t> cells_;
+};
+
 }  // namespace tequila
\ No newline at end of file
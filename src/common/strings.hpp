@@ -3,6 +3,9 @@
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <cstdint>
+#include <string_view>
+
 namespace tequila {
 
 template <typename StringType, typename... Args>
@@ -58,4 +61,25 @@ inline auto joinRange(Separator&& separator, Range&& range) {
   return ss.str();
 }
 
+// Returns the 64-bit FNV-1a hash of the bytes. Unlike std::hash the result is
+// fully specified so it can identify data persisted across runs and builds.
+inline uint64_t stableHash(
+    std::string_view data, uint64_t seed = 14695981039346656037ull) {
+  uint64_t ret = seed;
+  for (unsigned char c : data) {
+    ret ^= c;
+    ret *= 1099511628211ull;
+  }
+  return ret;
+}
+
+// Combines the value into a stable hash one little-endian byte at a time.
+inline uint64_t stableHashCombine(uint64_t seed, uint64_t value) {
+  for (int i = 0; i < 8; i += 1) {
+    seed ^= (value >> (8 * i)) & 0xff;
+    seed *= 1099511628211ull;
+  }
+  return seed;
+}
+
 }  // namespace tequila
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <boost/integer/integer_log2.hpp>
 
+#include "src/common/glstate.hpp"
 #include "src/common/images.hpp"
 #include "src/common/opengl.hpp"
 
@@ -16,7 +17,7 @@ Texture::Texture(const ImageTensor& pixels) {
   glGenTextures(1, &texture_);
 
   // Set the textures pixel data.
-  glBindTexture(GL_TEXTURE_2D, texture_);
+  glState().bindTexture(0, GL_TEXTURE_2D, texture_);
   glTexParameteri(
       GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -34,11 +35,12 @@ Texture::Texture(const ImageTensor& pixels) {
       GL_UNSIGNED_BYTE,
       pixels.data());
   glGenerateMipmap(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState().bindTexture(0, GL_TEXTURE_2D, 0);
 }
 
 Texture::~Texture() {
   if (texture_) {
+    glState().deleteTexture(texture_);
     glDeleteTextures(1, &texture_);
   }
 }
@@ -58,13 +60,21 @@ TextureOutput::TextureOutput(int width, int height, gl::GLenum format)
   glGenTextures(1, &texture_);
 
   // Set the textures pixel data.
-  glBindTexture(GL_TEXTURE_2D, texture_);
+  glState().bindTexture(0, GL_TEXTURE_2D, texture_);
   glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
-  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Filter linearly so that outputs can be resampled at other sizes (e.g. by
+  // post-processing filters) and clamp to avoid bleeding across edges.
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glState().bindTexture(0, GL_TEXTURE_2D, 0);
 }
 
 TextureOutput::~TextureOutput() {
   if (texture_) {
+    glState().deleteTexture(texture_);
     glDeleteTextures(1, &texture_);
   }
 }
@@ -85,14 +95,15 @@ MultisampleTextureOutput::MultisampleTextureOutput(
   glGenTextures(1, &texture_);
 
   // Set the textures pixel data.
-  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture_);
+  glState().bindTexture(0, GL_TEXTURE_2D_MULTISAMPLE, texture_);
   glTexImage2DMultisample(
       GL_TEXTURE_2D_MULTISAMPLE, samples, format, width, height, true);
-  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+  glState().bindTexture(0, GL_TEXTURE_2D_MULTISAMPLE, 0);
 }
 
 MultisampleTextureOutput::~MultisampleTextureOutput() {
   if (texture_) {
+    glState().deleteTexture(texture_);
     glDeleteTextures(1, &texture_);
   }
 }
@@ -117,9 +128,15 @@ TextureArray::TextureArray(const std::vector<ImageTensor>& pixels) {
 
   // Create texture object and allocate storage.
   glGenTextures(1, &texture_);
-  glBindTexture(GL_TEXTURE_2D_ARRAY, texture_);
+  glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture_);
   glTexStorage3D(
       GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, pixels.size());
+  texture_size_ = 0;
+  for (size_t level = 0; level < levels; level += 1) {
+    auto level_width = std::max<size_t>(width >> level, 1);
+    auto level_height = std::max<size_t>(height >> level, 1);
+    texture_size_ += 4 * level_width * level_height * pixels.size();
+  }
 
   // Set texture filter options.
   glTexParameteri(
@@ -149,30 +166,37 @@ TextureArray::TextureArray(const std::vector<ImageTensor>& pixels) {
   // Generate mipmaps.
   glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
 
-  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
 }
 
 TextureArray::~TextureArray() {
   if (texture_) {
+    glState().deleteTexture(texture_);
     glDeleteTextures(1, &texture_);
   }
 }
 
-TextureArray::TextureArray(TextureArray&& other) : texture_(0) {
+TextureArray::TextureArray(TextureArray&& other)
+    : texture_(0), texture_size_(0) {
   *this = std::move(other);
 }
 
 TextureArray& TextureArray::operator=(TextureArray&& other) {
   std::swap(texture_, other.texture_);
+  std::swap(texture_size_, other.texture_size_);
   return *this;
 }
 
+size_t TextureArray::gpuBytes() const {
+  return texture_size_;
+}
+
 TextureCube::TextureCube(const std::vector<ImageTensor>& pixels) {
   ENFORCE(pixels.size() == 6);
 
   // Create texture object.
   glGenTextures(1, &texture_);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture_);
+  glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture_);
 
   // Set texture filter options.
   // TODO: Consider adding mipmapping by default.
@@ -196,11 +220,12 @@ TextureCube::TextureCube(const std::vector<ImageTensor>& pixels) {
         pixels.at(i).data());
   }
 
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
 }
 
 TextureCube::~TextureCube() {
   if (texture_) {
+    glState().deleteTexture(texture_);
     glDeleteTextures(1, &texture_);
   }
 }
@@ -216,13 +241,7 @@ TextureCube& TextureCube::operator=(TextureCube&& other) {
 
 TextureBinding::TextureBinding(Texture& texture, int location)
     : texture_(texture), location_(location) {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D, texture_.texture_);
-}
-
-TextureBinding::~TextureBinding() noexcept {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState().bindTexture(location_, GL_TEXTURE_2D, texture_.texture_);
 }
 
 int TextureBinding::location() const {
@@ -231,13 +250,11 @@ int TextureBinding::location() const {
 
 TextureOutputBinding::TextureOutputBinding(TextureOutput& texture, int location)
     : texture_(texture), location_(location) {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D, texture_.texture_);
+  glState().bindTexture(location_, GL_TEXTURE_2D, texture_.texture_);
 }
 
 TextureOutputBinding::~TextureOutputBinding() noexcept {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState().bindTexture(location_, GL_TEXTURE_2D, 0);
 }
 
 int TextureOutputBinding::location() const {
@@ -247,13 +264,12 @@ int TextureOutputBinding::location() const {
 MultisampleTextureOutputBinding::MultisampleTextureOutputBinding(
     MultisampleTextureOutput& texture, int location)
     : texture_(texture), location_(location) {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture_.texture_);
+  glState().bindTexture(
+      location_, GL_TEXTURE_2D_MULTISAMPLE, texture_.texture_);
 }
 
 MultisampleTextureOutputBinding::~MultisampleTextureOutputBinding() noexcept {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+  glState().bindTexture(location_, GL_TEXTURE_2D_MULTISAMPLE, 0);
 }
 
 int MultisampleTextureOutputBinding::location() const {
@@ -262,13 +278,7 @@ int MultisampleTextureOutputBinding::location() const {
 
 TextureArrayBinding::TextureArrayBinding(TextureArray& texture, int location)
     : texture_(texture), location_(location) {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D_ARRAY, texture_.texture_);
-}
-
-TextureArrayBinding::~TextureArrayBinding() noexcept {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glState().bindTexture(location_, GL_TEXTURE_2D_ARRAY, texture_.texture_);
 }
 
 int TextureArrayBinding::location() const {
@@ -277,13 +287,7 @@ int TextureArrayBinding::location() const {
 
 TextureCubeBinding::TextureCubeBinding(TextureCube& texture, int location)
     : texture_(texture), location_(location) {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture_.texture_);
-}
-
-TextureCubeBinding::~TextureCubeBinding() noexcept {
-  glActiveTexture(GL_TEXTURE0 + location_);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  glState().bindTexture(location_, GL_TEXTURE_CUBE_MAP, texture_.texture_);
 }
 
 int TextureCubeBinding::location() const {
@@ -112,8 +112,12 @@ class TextureArray {
   TextureArray(const TextureArray&) = delete;
   TextureArray& operator=(const TextureArray&) = delete;
 
+  // Returns the bytes of device memory owned by this texture (with mipmaps).
+  size_t gpuBytes() const;
+
  private:
   gl::GLuint texture_;
+  size_t texture_size_;
 
   friend class TextureArrayBinding;
 };
@@ -137,10 +141,13 @@ class TextureCube {
   friend class TextureCubeBinding;
 };
 
+// Texture bindings bind textures to texture units through glState(). Bindings
+// of sampled textures leave them bound when destroyed so that rebinding them
+// (e.g. for the next frame) is skipped. Bindings of render outputs unbind them
+// so they are not left bound while being rendered to.
 class TextureBinding {
  public:
   TextureBinding(Texture& texture, int location);
-  ~TextureBinding() noexcept;
 
   int location() const;
 
@@ -177,7 +184,6 @@ class MultisampleTextureOutputBinding {
 class TextureArrayBinding {
  public:
   TextureArrayBinding(TextureArray& texture, int location);
-  ~TextureArrayBinding() noexcept;
 
   int location() const;
 
@@ -189,7 +195,6 @@ class TextureArrayBinding {
 class TextureCubeBinding {
  public:
   TextureCubeBinding(TextureCube& texture, int location);
-  ~TextureCubeBinding() noexcept;
 
   int location() const;
 
@@ -98,6 +98,11 @@ size_t VoxelArray::size() const {
   return voxels_.size();
 }
 
+size_t VoxelArray::cpuBytes() const {
+  return sizeof(*this) - sizeof(voxels_) - sizeof(surface_voxels_) +
+      voxels_.cpuBytes() + surface_voxels_.cpuBytes();
+}
+
 const glm::mat4& VoxelArray::transform() const {
   return transform_;
 }
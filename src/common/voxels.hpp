@@ -4,8 +4,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <array>
+#include <map>
 #include <tuple>
+#include <utility>
 #include <unordered_map>
 #include <vector>
 
@@ -34,6 +37,7 @@ class VoxelArray {
   std::vector<std::tuple<int, int, int>> surfaceVertices() const;
 
   size_t size() const;
+  size_t cpuBytes() const;
 
   const glm::mat4& transform() const;
   Mesh toMesh() const;
@@ -54,6 +58,116 @@ class VoxelArray {
   glm::mat4 transform_;
 };
 
+// Downsamples voxels (e.g. a VoxelArray or CubeStore) by half along each axis
+// for distant levels of detail. A coarse voxel is filled if at least half of
+// its eight fine voxels are and takes their most common value.
+template <typename Voxels>
+CubeStore<uint32_t> downsampleVoxels(const Voxels& voxels) {
+  int size = voxels.size() / 2;
+  CubeStore<uint32_t> ret(size, 0);
+  std::array<uint32_t, 8> values;
+  for (int z = 0; z < size; z += 1) {
+    for (int y = 0; y < size; y += 1) {
+      for (int x = 0; x < size; x += 1) {
+        size_t count = 0;
+        for (int i = 0; i < 8; i += 1) {
+          auto value = voxels.get(
+              2 * x + (i & 1), 2 * y + (i >> 1 & 1), 2 * z + (i >> 2 & 1));
+          if (value) {
+            values[count++] = value;
+          }
+        }
+        if (2 * count < values.size()) {
+          continue;
+        }
+
+        // Pick the most common value, preferring the first seen on ties.
+        auto end = values.begin() + count;
+        uint32_t best = 0;
+        int best_count = 0;
+        for (auto it = values.begin(); it != end; ++it) {
+          int value_count = std::count(values.begin(), end, *it);
+          if (value_count > best_count) {
+            best = *it;
+            best_count = value_count;
+          }
+        }
+        ret.set(x, y, z, best);
+      }
+    }
+  }
+  return ret;
+}
+
+// Summarizes whether the voxels are all empty, all filled or a mix of both.
+template <typename Voxels>
+Occupancy voxelOccupancy(const Voxels& voxels) {
+  int size = voxels.size();
+  bool empty = false, filled = false;
+  for (int z = 0; z < size; z += 1) {
+    for (int y = 0; y < size; y += 1) {
+      for (int x = 0; x < size; x += 1) {
+        (voxels.get(x, y, z) ? filled : empty) = true;
+        if (empty && filled) {
+          return Occupancy::MIXED;
+        }
+      }
+    }
+  }
+  return filled ? Occupancy::FULL : Occupancy::EMPTY;
+}
+
+// Returns boxes of entirely filled voxels as their min and max corners to use
+// as conservative occluders. Voxels are grouped in blocks of the given size
+// and rows of filled blocks along x are merged with equal rows along z.
+template <typename Voxels>
+std::vector<std::pair<glm::ivec3, glm::ivec3>> occluderBoxes(
+    const Voxels& voxels, int block_size) {
+  int size = voxels.size() / block_size;
+  auto filled = [&](int bx, int by, int bz) {
+    for (int z = bz * block_size; z < (bz + 1) * block_size; z += 1) {
+      for (int y = by * block_size; y < (by + 1) * block_size; y += 1) {
+        for (int x = bx * block_size; x < (bx + 1) * block_size; x += 1) {
+          if (!voxels.get(x, y, z)) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  };
+
+  std::vector<std::pair<glm::ivec3, glm::ivec3>> ret;
+  for (int y = 0; y < size; y += 1) {
+    // Maps the rows of the previous z to the boxes they extend.
+    std::map<std::pair<int, int>, size_t> prev_rows, rows;
+    for (int z = 0; z < size; z += 1) {
+      rows.clear();
+      for (int x = 0; x < size;) {
+        if (!filled(x, y, z)) {
+          x += 1;
+          continue;
+        }
+        int x0 = x;
+        for (; x < size && filled(x, y, z); x += 1) {
+        }
+        auto it = prev_rows.find({x0, x});
+        if (it != prev_rows.end()) {
+          ret[it->second].second.z += block_size;
+          rows[{x0, x}] = it->second;
+        } else {
+          rows[{x0, x}] = ret.size();
+          ret.emplace_back(
+              block_size * glm::ivec3(x0, y, z),
+              block_size * glm::ivec3(x, y + 1, z + 1));
+        }
+      }
+      std::swap(prev_rows, rows);
+    }
+  }
+  return ret;
+}
+
 // Convenience routine for marching over voxel coords intersecting a ray.
 template <typename Function>
 inline void marchVoxels(
@@ -2,6 +2,7 @@
 
 #include <boost/any.hpp>
 
+#include <memory>
 #include <unordered_map>
 
 #include "src/common/errors.hpp"
@@ -57,7 +58,48 @@ class Window {
   }
 
   bool inContext() {
-    return glfwGetCurrentContext();
+    return glfwGetCurrentContext() == window_;
+  }
+
+  // Makes the window's context current on the calling thread and binds the
+  // OpenGL functions for it.
+  void makeContextCurrent() {
+    glfwMakeContextCurrent(window_);
+    glbinding::initialize(
+        reinterpret_cast<glbinding::ContextHandle>(window_),
+        glfwGetProcAddress);
+  }
+
+  void releaseContext() {
+    glbinding::releaseContext(
+        reinterpret_cast<glbinding::ContextHandle>(window_));
+    glfwMakeContextCurrent(nullptr);
+  }
+
+  // Creates a hidden window whose context shares objects (e.g. buffers and
+  // textures but not vertex arrays) with this window's context. This must be
+  // called on the main thread but the context may be used on any one thread.
+  std::shared_ptr<Window> makeSharedContext() {
+    glfwWindowHint(GLFW_VISIBLE, false);
+    auto glfw_window = glfwCreateWindow(1, 1, "", nullptr, window_);
+    glfwWindowHint(GLFW_VISIBLE, true);
+    ENFORCE(glfw_window);
+    return std::make_shared<Window>(glfw_window);
+  }
+
+  // Returns the refresh rate (i.e. the vsync target) of the window's monitor
+  // or of the primary monitor if the window isn't full screen.
+  int refreshRate() {
+    constexpr int kDefaultRefreshRate = 60;
+    auto monitor = glfwGetWindowMonitor(window_);
+    if (!monitor) {
+      monitor = glfwGetPrimaryMonitor();
+    }
+    auto mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+    if (mode && mode->refreshRate > 0) {
+      return mode->refreshRate;
+    }
+    return kDefaultRefreshRate;
   }
 
  private:
@@ -5,6 +5,7 @@
 
 #include "src/common/audio.hpp"
 #include "src/common/errors.hpp"
+#include "src/common/glstate.hpp"
 #include "src/common/lua.hpp"
 #include "src/common/opengl.hpp"
 #include "src/common/resources.hpp"
@@ -35,7 +36,7 @@ auto getWorldCamera() {
   camera->fov = glm::radians(45.0f);
   camera->aspect = 4.0f / 3.0f;
   camera->near_distance = 0.1f;
-  camera->far_distance = 256.0f;
+  camera->far_distance = 1024.0f;
   return camera;
 }
 
@@ -91,7 +92,7 @@ void run() {
 
   // Define a factory to build the global asychronous task executor.
   auto executor_factory = [](const Registry& registry) {
-    return std::make_shared<QueueExecutor>(10);
+    return std::make_shared<WorkStealingExecutor>(defaultThreadCount());
   };
 
   // Define a factory to build the world resources.
@@ -99,6 +100,7 @@ void run() {
     return std::make_shared<Resources>(
         ResourcesBuilder()
             .withSeed<OpenGLExecutor>(registry.get<OpenGLContextExecutor>())
+            .withSeed<OpenGLUploader>(registry.get<OpenGLUploadExecutor>())
             .withSeed<ScriptContext>(getScriptContext())
             .withSeed<WorldCamera>(getWorldCamera())
             .withSeed<WorldLight>(getWorldLight())
@@ -106,13 +108,15 @@ void run() {
             .withSeed<WorldName>(world_name)
             .withSeed<WorldStyleName>(style_name)
             .withSeed<WorldUI>(getWorldUI())
+            .withStore(std::make_shared<TableResourceStore>(
+                std::make_shared<Table>(format("%1%_cache", world_name))))
             .build());
   };
 
   // Define a factory to build the asynchronous interface to world resources.
   auto async_resources_factory = [world_name](const Registry& registry) {
     return std::make_shared<AsyncResources>(
-        registry.get<Resources>(), registry.get<QueueExecutor>());
+        registry.get<Resources>(), registry.get<WorkStealingExecutor>());
   };
 
   // Initialize game registry.
@@ -121,11 +125,12 @@ void run() {
       RegistryBuilder()
           .bind<Window>(app.makeWindow(1024, 768, "Tequila!", nullptr, nullptr))
           .bind<AsyncResources>(async_resources_factory)
-          .bind<QueueExecutor>(executor_factory)
           .bind<Resources>(resources_factory)
           .bind<Stats>(std::make_shared<Stats>())
+          .bind<WorkStealingExecutor>(executor_factory)
           .bindToDefaultFactory<EventHandler>()
           .bindToDefaultFactory<OpenGLContextExecutor>()
+          .bindToDefaultFactory<OpenGLUploadExecutor>()
           .bindToDefaultFactory<RectUIRenderer>()
           .bindToDefaultFactory<ScriptExecutor>()
           .bindToDefaultFactory<SkyRenderer>()
@@ -145,8 +150,8 @@ void run() {
   // Clean up asynchronous tasks on termination.
   Finally finally([&] {
     // Unblock and wait for any outstanding asynchronous tasks.
-    registry.get<QueueExecutor>()->close();
-    while (!registry.get<QueueExecutor>()->isDone()) {
+    registry.get<WorkStealingExecutor>()->close();
+    while (!registry.get<WorkStealingExecutor>()->isDone()) {
       registry.get<OpenGLContextExecutor>()->process();
     }
     std::cout << "Shutting down!" << std::endl;
@@ -162,6 +167,9 @@ void run() {
     Trace::tag("update_game");
     registry.get<EventHandler>()->update(dt);
 
+    // Publish the memory held by cached resources.
+    registry.get<Resources>()->reportMemory(*registry.get<Stats>());
+
     // Process OpenGL updates that are blocking async tasks.
     Trace::tag("update_gl");
     registry.get<OpenGLContextExecutor>()->process();
@@ -171,6 +179,7 @@ void run() {
     gl::glClear(gl::GL_COLOR_BUFFER_BIT | gl::GL_DEPTH_BUFFER_BIT);
     registry.get<WorldRenderer>()->draw();
     registry.get<UIRenderer>()->draw();
+    glState().reportStats(*registry.get<Stats>());
   });
 }
 
@@ -14,5 +14,7 @@ PYBIND11_MODULE(spatial, m) {
       .def(py::init<size_t, size_t>())
       .def("__len__", &Octree::cellCount)
       .def("depth", &Octree::treeDepth)
-      .def("intersect_box", &Octree::intersectBox);
+      .def("intersect_box", [](const Octree& octree, Octree::BoxTuple box) {
+        return octree.intersectBox(box);
+      });
 }
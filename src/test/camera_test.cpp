@@ -5,7 +5,9 @@
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <iterator>
 #include <random>
+#include <unordered_set>
 
 #include "src/common/camera.hpp"
 #include "src/common/spatial.hpp"
@@ -13,6 +15,60 @@
 
 namespace tequila {
 
+namespace {
+
+// The original algorithm mapping the corners of every cell to clip space.
+auto computeVisibleCellsInClipSpace(
+    const Camera& camera, const Octree& octree) {
+  Eigen::Matrix4f pv_mat;
+  auto view_proj = camera.projectionMatrix() * camera.viewMatrix();
+  for (int col = 0; col < 4; col += 1) {
+    for (int row = 0; row < 4; row += 1) {
+      pv_mat(row, col) = view_proj[col][row];
+    }
+  }
+  Eigen::Matrix<float, 4, 8> bb_mat;
+  bb_mat.setOnes();
+  for (int i = 0; i < 8; i += 1) {
+    bb_mat(0, i) = i & 1;
+    bb_mat(1, i) = i >> 1 & 1;
+    bb_mat(2, i) = i >> 2 & 1;
+  }
+
+  std::vector<int64_t> ret;
+  octree.search([&](int64_t cell) {
+    auto [x0, y0, z0, x1, y1, z1] = octree.cellBox(cell);
+    Eigen::Matrix4f tr_mat;
+    tr_mat.setIdentity();
+    tr_mat(0, 3) = x0;
+    tr_mat(1, 3) = y0;
+    tr_mat(2, 3) = z0;
+    tr_mat(0, 0) = x1 - x0;
+    tr_mat(1, 1) = y1 - y0;
+    tr_mat(2, 2) = z1 - z0;
+    Eigen::Array<float, 4, 8> clip = pv_mat * tr_mat * bb_mat;
+    for (int i = 0; i < 3; i += 1) {
+      if ((clip.row(i) < -clip.row(3)).all() ||
+          (clip.row(i) > clip.row(3)).all()) {
+        return false;
+      }
+    }
+    bool inside = true;
+    for (int i = 0; i < 3; i += 1) {
+      inside = inside && (clip.row(i) > -1.2f * clip.row(3)).all() &&
+          (clip.row(i) < 1.2f * clip.row(3)).all();
+    }
+    if (octree.cellLevel(cell) + 1 >= octree.treeDepth() || inside) {
+      ret.push_back(cell);
+      return false;
+    }
+    return true;
+  });
+  return ret;
+}
+
+}  // namespace
+
 TEST_CASE("Test visible cell algorithm", "[camera]") {
   using namespace Catch::Matchers;
 
@@ -56,4 +112,135 @@ TEST_CASE("Test visible cell algorithm", "[camera]") {
   REQUIRE(cells_volume <= 5 * frustumVolume(camera));
 }
 
-}  // namespace tequila
\ No newline at end of file
+TEST_CASE("Test visible cells match clip space culling", "[camera]") {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> pos(0.0f, 4096.0f);
+  std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
+  Octree octree(32, 256);
+  for (int i = 0; i < 20; i += 1) {
+    Camera camera;
+    camera.position = glm::vec3(pos(gen), pos(gen), pos(gen));
+    camera.view = glm::normalize(glm::vec3(dir(gen), dir(gen), dir(gen)));
+    camera.far_distance = 256.0f;
+
+    // The algorithms are equivalent up to rounding so they may only disagree
+    // on a few cells touching the frustum planes.
+    auto cells = computeVisibleCells(camera, octree);
+    auto expected = computeVisibleCellsInClipSpace(camera, octree);
+    std::sort(cells.begin(), cells.end());
+    std::sort(expected.begin(), expected.end());
+    std::vector<int64_t> mismatches;
+    std::set_symmetric_difference(
+        cells.begin(),
+        cells.end(),
+        expected.begin(),
+        expected.end(),
+        std::back_inserter(mismatches));
+    REQUIRE(mismatches.size() <= expected.size() / 50);
+  }
+}
+
+TEST_CASE("Update visible cells incrementally", "[camera]") {
+  Octree octree(32, 256);
+  Camera camera;
+  camera.position = glm::vec3(2048.0f, 2048.0f, 2048.0f);
+  camera.far_distance = 256.0f;
+
+  VisibleCellSet incremental(octree);
+  std::unordered_set<int64_t> cells;
+  size_t retested = 0;
+  for (int i = 0; i < 100; i += 1) {
+    camera.position += glm::vec3(0.5f, 0.1f, 0.3f);
+    camera.view = glm::vec3(std::sin(0.01f * i), 0.2f, std::cos(0.01f * i));
+    auto update = incremental.update(camera);
+    retested += update.retested;
+
+    // Applying the deltas yields the visible cells.
+    for (auto cell : update.removed) {
+      REQUIRE(cells.erase(cell));
+    }
+    for (auto cell : update.added) {
+      REQUIRE(cells.insert(cell).second);
+    }
+    auto snapshot = incremental.snapshot();
+    REQUIRE(snapshot.version == update.version);
+    REQUIRE(
+        cells ==
+        std::unordered_set(snapshot.added.begin(), snapshot.added.end()));
+
+    // The visible cells match a fresh update.
+    auto fresh = VisibleCellSet(octree).update(camera).added;
+    REQUIRE(cells == std::unordered_set(fresh.begin(), fresh.end()));
+  }
+
+  // Continuous motion only re-tests a fraction of the cells.
+  auto fresh = VisibleCellSet(octree).update(camera);
+  REQUIRE(retested < 100 * fresh.retested / 2);
+}
+
+TEST_CASE("Visible cells skip empty space", "[camera]") {
+  Camera camera;
+  camera.position = glm::vec3(2048.0f, 2048.0f, 2048.0f);
+  camera.view = glm::normalize(glm::vec3(1.0f, 0.1f, 1.0f));
+  camera.far_distance = 1024.0f;
+  Octree octree(32, 256);
+
+  // Terrain fills the lower half of the world, leaving the sky empty.
+  constexpr int kLevel = 5;
+  auto occupancy = std::make_shared<OctreeOccupancy>(octree, kLevel);
+  int size = octree.size();
+  int cell_size = size >> kLevel;
+  for (int z = 0; z < size; z += cell_size) {
+    for (int y = 0; y < size; y += cell_size) {
+      for (int x = 0; x < size; x += cell_size) {
+        auto cell = octree.cellAt(kLevel, x, y, z);
+        if (y >= 2048) {
+          occupancy->set(cell, Occupancy::EMPTY);
+        } else if (y + cell_size < 2048) {
+          occupancy->set(cell, Occupancy::FULL);
+        }
+      }
+    }
+  }
+
+  auto all_cells = computeVisibleCells(camera, octree);
+  auto cells = computeVisibleCells(camera, octree, occupancy.get());
+  REQUIRE(2 * cells.size() < all_cells.size());
+  for (auto cell : cells) {
+    REQUIRE(occupancy->get(cell) != Occupancy::EMPTY);
+  }
+
+  // Incremental updates skip the same cells.
+  VisibleCellSet incremental(octree, occupancy);
+  for (auto cell : incremental.update(camera).added) {
+    REQUIRE(occupancy->get(cell) != Occupancy::EMPTY);
+  }
+}
+
+TEST_CASE("Benchmark visible cells", "[.][benchmark]") {
+  Camera camera;
+  camera.position = glm::vec3(2048.0f, 2048.0f, 2048.0f);
+  camera.view = glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f));
+  camera.far_distance = 1024.0f;
+  Octree octree(32, 256);
+
+  constexpr int kIterations = 1000;
+  size_t cells = 0;
+  {
+    Timer timer("computeVisibleCells");
+    for (int i = 0; i < kIterations; i += 1) {
+      cells += computeVisibleCells(camera, octree).size();
+    }
+  }
+  size_t expected_cells = 0;
+  {
+    Timer timer("computeVisibleCellsInClipSpace");
+    for (int i = 0; i < kIterations; i += 1) {
+      expected_cells += computeVisibleCellsInClipSpace(camera, octree).size();
+    }
+  }
+  REQUIRE(cells > 0);
+  REQUIRE(expected_cells > 0);
+}
+
+}  // namespace tequila
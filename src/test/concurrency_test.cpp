@@ -3,7 +3,12 @@
 
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 #include "src/common/concurrency.hpp"
@@ -28,4 +33,240 @@ TEST_CASE("Test queue executor", "[concurrency]") {
   REQUIRE(counter == 10000);
 }
 
+TEST_CASE("Test bounded MPMC queue", "[concurrency]") {
+  // Push more values than the queue's capacity from many producers.
+  BoundedMPMCQueue<int> queue(64);
+  std::atomic<int64_t> sum(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i += 1) {
+    threads.emplace_back([&] {
+      while (auto value = queue.pop()) {
+        sum += *value;
+      }
+    });
+  }
+  for (int i = 0; i < 4; i += 1) {
+    threads.emplace_back([&] {
+      for (int j = 1; j <= 10000; j += 1) {
+        queue.push(j);
+      }
+    });
+  }
+
+  // Wait for the producers and then for the queue to drain.
+  for (int i = 4; i < 8; i += 1) {
+    threads.at(i).join();
+  }
+  while (!queue.isEmpty()) {
+    std::this_thread::yield();
+  }
+  while (sum < 4 * 50005000ll) {
+    std::this_thread::yield();
+  }
+
+  // Closing the queue should unblock all the consumers.
+  queue.close();
+  for (int i = 0; i < 4; i += 1) {
+    threads.at(i).join();
+  }
+  REQUIRE(sum == 4 * 50005000ll);
+  REQUIRE(!queue.isOpen());
+  REQUIRE(!queue.pop());
+}
+
+TEST_CASE("Test bounded MPMC queue blocks when full", "[concurrency]") {
+  BoundedMPMCQueue<int> queue(2);
+  queue.push(1);
+  queue.push(2);
+
+  // The producer should block until a consumer frees a slot.
+  std::atomic<bool> pushed(false);
+  std::thread producer([&] {
+    queue.push(3);
+    pushed = true;
+  });
+  using namespace std::chrono_literals;
+  std::this_thread::sleep_for(50ms);
+  REQUIRE(!pushed);
+  REQUIRE(1 == *queue.pop());
+  producer.join();
+  REQUIRE(pushed);
+  REQUIRE(2 == *queue.pop());
+  REQUIRE(3 == *queue.pop());
+
+  // Pushing to a closed queue should fail.
+  queue.close();
+  REQUIRE_THROWS(queue.push(4));
+}
+
+TEST_CASE("Test async result continuations", "[concurrency]") {
+  // Continuations attached before and after fulfillment should both run.
+  AsyncResult<int> result;
+  auto doubled = result.then([](int x) { return 2 * x; });
+  auto flattened = doubled.then([](int x) {
+    AsyncResult<std::string> ret;
+    ret.setValue(std::to_string(x));
+    return ret;
+  });
+  REQUIRE(!doubled.isReady());
+  std::thread([result]() mutable { result.setValue(21); }).join();
+  REQUIRE(42 == doubled.get());
+  REQUIRE("42" == flattened.get());
+  REQUIRE(43 == doubled.then([](int x) { return x + 1; }).get());
+
+  // Exceptions should propagate through continuations.
+  AsyncResult<int> failed;
+  auto chained = failed.then([](int x) { return x; });
+  auto future = chained.future();
+  failed.setException(
+      std::make_exception_ptr(std::runtime_error("Expected failure.")));
+  REQUIRE_THROWS(chained.get());
+  REQUIRE_THROWS(future.get());
+  REQUIRE(7 == makeReadyAsyncResult(7).get());
+}
+
+TEST_CASE("Test when all", "[concurrency]") {
+  AsyncResult<int> a;
+  AsyncResult<std::string> b;
+  auto both = whenAll(a, b);
+  a.setValue(1);
+  REQUIRE(!both.isReady());
+  b.setValue("b");
+  REQUIRE(std::make_tuple(1, std::string("b")) == both.get());
+
+  // Vectors of results are gathered in order.
+  std::vector<AsyncResult<int>> results(3);
+  auto all = whenAll(results);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; i += 1) {
+    threads.emplace_back([&results, i] { results[i].setValue(i); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(std::vector<int>{0, 1, 2} == all.get());
+  REQUIRE(whenAll(std::vector<AsyncResult<int>>()).get().empty());
+
+  // Any failure fails the combined result.
+  std::vector<AsyncResult<int>> failing(2);
+  auto failed = whenAll(failing);
+  failing[1].setException(
+      std::make_exception_ptr(std::runtime_error("Expected failure.")));
+  REQUIRE_THROWS(failed.get());
+  failing[0].setValue(0);
+}
+
+TEST_CASE("Test work stealing executor", "[concurrency]") {
+  std::atomic<int> counter(0);
+
+  WorkStealingExecutor executor(10);
+  for (int i = 0; i < 10000; i += 1) {
+    executor.schedule([&] { counter++; });
+  }
+
+  // Spin until all tasks are done.
+  while (counter < 10000) {
+  };
+
+  // Make sure no further tasks execute.
+  using namespace std::chrono_literals;
+  std::this_thread::sleep_for(100ms);
+  REQUIRE(counter == 10000);
+}
+
+TEST_CASE("Test work stealing executor nested tasks", "[concurrency]") {
+  // Recursively fan out tasks that wait on their children. With a single
+  // worker this deadlocks unless waiting workers run the queued tasks.
+  WorkStealingExecutor executor(1);
+  std::function<int(int)> fib = [&](int n) {
+    if (n < 2) {
+      return n;
+    }
+    auto a = executor.schedule([&, n] { return fib(n - 1); });
+    auto b = executor.schedule([&, n] { return fib(n - 2); });
+    return executor.wait(a) + executor.wait(b);
+  };
+  auto future = executor.schedule([&] { return fib(15); });
+  REQUIRE(610 == executor.wait(future));
+
+  // Exceptions should propagate through the returned futures.
+  auto error = executor.schedule([]() -> int { throw std::runtime_error(""); });
+  REQUIRE_THROWS(executor.wait(error));
+}
+
+TEST_CASE("Test work stealing executor only runs nested tasks", "[concurrency]") {
+  // A waiting worker shouldn't run tasks unrelated to the one it's running.
+  WorkStealingExecutor executor(1);
+  AsyncResult<int> result;
+  std::atomic<bool> waiting(false), helped(false);
+  auto outer = executor.schedule([&] {
+    waiting = true;
+    auto ret = executor.wait(result);
+    waiting = false;
+    return ret;
+  });
+  while (!waiting) {
+    std::this_thread::yield();
+  }
+  auto unrelated = executor.schedule([&] { helped = waiting.load(); });
+  using namespace std::chrono_literals;
+  std::this_thread::sleep_for(50ms);
+  result.setValue(1);
+  REQUIRE(1 == outer.get());
+  unrelated.get();
+  REQUIRE(!helped);
+}
+
+template <typename Queue>
+double queueThroughput(int producers, int consumers) {
+  constexpr int kValueCount = 1 << 20;
+  Queue queue;
+  std::atomic<int> popped(0);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < consumers; i += 1) {
+    threads.emplace_back([&] {
+      while (queue.pop()) {
+        popped++;
+      }
+    });
+  }
+  for (int i = 0; i < producers; i += 1) {
+    threads.emplace_back([&, i] {
+      for (int j = i; j < kValueCount; j += producers) {
+        queue.push(j);
+      }
+    });
+  }
+  while (popped < kValueCount) {
+    std::this_thread::yield();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  queue.close();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto seconds = std::chrono::duration<double>(end - start).count();
+  return kValueCount / seconds;
+}
+
+// Run explicitly with: concurrency_test "[benchmark]"
+TEST_CASE("Benchmark MPMC queue throughput", "[.][benchmark]") {
+  for (int producers : {1, 2, 4, 8}) {
+    for (int consumers : {1, 2, 4, 8}) {
+      auto locked = queueThroughput<MPMCQueue<int>>(producers, consumers);
+      auto bounded =
+          queueThroughput<BoundedMPMCQueue<int>>(producers, consumers);
+      std::cout << format(
+                       "producers=%1% consumers=%2% "
+                       "MPMCQueue=%3$.2fM/s BoundedMPMCQueue=%4$.2fM/s",
+                       producers,
+                       consumers,
+                       locked / 1e6,
+                       bounded / 1e6)
+                << std::endl;
+    }
+  }
+}
+
 }  // namespace tequila
\ No newline at end of file
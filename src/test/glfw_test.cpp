@@ -94,7 +94,7 @@ void run() {
       shader.uniform("modelview_matrix", camera.viewMatrix());
       shader.uniform("normal_matrix", camera.normalMatrix());
       shader.uniform("projection_matrix", camera.projectionMatrix());
-      mesh.draw(shader);
+      mesh.draw();
     });
   });
 }
@@ -0,0 +1,120 @@
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+#include <glm/glm.hpp>
+
+#include "src/common/camera.hpp"
+#include "src/common/occlusion.hpp"
+#include "src/common/voxels.hpp"
+
+namespace tequila {
+
+TEST_CASE("Occluders hide boxes behind them", "[occlusion]") {
+  Camera camera;
+  camera.view = glm::vec3(0.0f, 0.0f, 1.0f);
+  OcclusionBuffer buffer(128, 128);
+  buffer.clear(camera);
+  buffer.addOccluder(glm::vec3(-2, -2, 10), glm::vec3(2, 2, 12));
+  buffer.finish();
+
+  // Boxes behind the wall are hidden.
+  REQUIRE(buffer.isOccluded(glm::vec3(-1, -1, 20), glm::vec3(1, 1, 22)));
+  REQUIRE(buffer.isOccluded(glm::vec3(-5, -5, 50), glm::vec3(5, 5, 60)));
+
+  // Boxes in front of the wall, beside it or overlapping it are not.
+  REQUIRE(!buffer.isOccluded(glm::vec3(-1, -1, 5), glm::vec3(1, 1, 7)));
+  REQUIRE(!buffer.isOccluded(glm::vec3(12, -1, 40), glm::vec3(14, 1, 42)));
+  REQUIRE(!buffer.isOccluded(glm::vec3(-1, -1, 9), glm::vec3(1, 1, 20)));
+  REQUIRE(!buffer.isOccluded(glm::vec3(-40, -1, 40), glm::vec3(40, 1, 42)));
+
+  // Boxes behind the camera are left to frustum culling.
+  REQUIRE(!buffer.isOccluded(glm::vec3(-1, -1, -20), glm::vec3(1, 1, -18)));
+}
+
+TEST_CASE("Occlusion culls most shards in enclosed scenes", "[occlusion]") {
+  // The camera is inside a hollow shard of an otherwise solid grid of shards
+  // so that only the shards bordering the hollow one can be seen.
+  constexpr int kShardSize = 64;
+  constexpr int kGridSize = 8;
+  Camera camera;
+  camera.position = glm::vec3(3.5f * kShardSize);
+  camera.view = glm::normalize(glm::vec3(1.0f, 0.2f, 0.7f));
+  camera.far_distance = 1024.0f;
+  auto box = [&](int x, int y, int z) {
+    return std::pair(
+        glm::vec3(x, y, z) * float(kShardSize),
+        glm::vec3(x + 1, y + 1, z + 1) * float(kShardSize));
+  };
+  auto hollow = [](int x, int y, int z) {
+    return x == 3 && y == 3 && z == 3;
+  };
+
+  OcclusionBuffer buffer(256, 128);
+  buffer.clear(camera);
+  for (int z = 0; z < kGridSize; z += 1) {
+    for (int y = 0; y < kGridSize; y += 1) {
+      for (int x = 0; x < kGridSize; x += 1) {
+        if (!hollow(x, y, z)) {
+          auto [lo, hi] = box(x, y, z);
+          buffer.addOccluder(lo, hi);
+        }
+      }
+    }
+  }
+  buffer.finish();
+
+  // Count the shards inside the frustum hidden by occlusion.
+  auto planes = frustumPlanes(camera);
+  auto in_frustum = [&](const glm::vec3& lo, const glm::vec3& hi) {
+    for (const auto& p : planes) {
+      if (p[3] + p[0] * (p[0] > 0 ? hi.x : lo.x) +
+              p[1] * (p[1] > 0 ? hi.y : lo.y) +
+              p[2] * (p[2] > 0 ? hi.z : lo.z) <
+          0) {
+        return false;
+      }
+    }
+    return true;
+  };
+  int visible = 0, occluded = 0;
+  for (int z = 0; z < kGridSize; z += 1) {
+    for (int y = 0; y < kGridSize; y += 1) {
+      for (int x = 0; x < kGridSize; x += 1) {
+        auto [lo, hi] = box(x, y, z);
+        if (!in_frustum(lo, hi)) {
+          continue;
+        } else if (buffer.isOccluded(lo, hi)) {
+          int neighbors = std::abs(x - 3) + std::abs(y - 3) + std::abs(z - 3);
+          REQUIRE(neighbors > 1);
+          occluded += 1;
+        } else {
+          visible += 1;
+        }
+      }
+    }
+  }
+  REQUIRE(occluded >= visible);
+}
+
+TEST_CASE("Occluder boxes cover filled blocks", "[occlusion]") {
+  CubeStore<uint32_t> voxels(16, 0);
+  for (int z = 0; z < 16; z += 1) {
+    for (int y = 0; y < 8; y += 1) {
+      for (int x = 0; x < 16; x += 1) {
+        voxels.set(x, y, z, 1);
+      }
+    }
+  }
+  voxels.set(15, 7, 15, 0);
+
+  // The bottom half merges into one box except for the last block.
+  auto boxes = occluderBoxes(voxels, 4);
+  int volume = 0;
+  for (const auto& [lo, hi] : boxes) {
+    auto size = hi - lo;
+    volume += size.x * size.y * size.z;
+  }
+  REQUIRE(volume == 16 * 8 * 16 - 4 * 4 * 4);
+  REQUIRE(boxes.size() <= 4);
+}
+
+}  // namespace tequila
@@ -1,7 +1,10 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <iostream>
 
 #include "src/common/concurrency.hpp"
 #include "src/common/errors.hpp"
@@ -131,6 +134,117 @@ struct async_4 {
   }
 };
 
+struct async_5 {
+  auto operator()(ResourceDeps& deps) {
+    static int version = 0;
+    return version++;
+  }
+};
+
+struct async_6 {
+  auto operator()(ResourceDeps& deps, int x) {
+    static int version = 0;
+    auto base = deps.get<async_5>() + version++;
+    return makeReadyAsyncResult(0).then([base, x](int) {
+      AsyncResult<int> ret;
+      std::thread([ret, base, x]() mutable { ret.setValue(base + x); })
+          .detach();
+      return ret;
+    });
+  }
+};
+
+struct async_7 {
+  auto operator()(ResourceDeps& deps, int n) {
+    return whenAll(deps.getAsync<B>(n), deps.getAsync<async_6>(n))
+        .then([](const std::tuple<std::string, int>& values) {
+          return format("%1%:%2%", std::get<0>(values), std::get<1>(values));
+        });
+  }
+};
+
+int persist_root_offset = 0;
+
+struct persist_root {
+  auto operator()(ResourceDeps& deps, int x) {
+    return x + persist_root_offset;
+  }
+
+  static uint64_t digest(const int& value) {
+    return value;
+  }
+};
+
+struct persist_leaf {
+  static constexpr bool kPersistent = true;
+  static inline int builds = 0;
+
+  auto operator()(ResourceDeps& deps, int x) {
+    builds += 1;
+    return format("L%1%", deps.get<persist_root>(x));
+  }
+};
+
+class MemoryResourceStore : public ResourceStore {
+ public:
+  boost::optional<std::string> load(const std::string& key) override {
+    boost::optional<std::string> ret;
+    if (data_.count(key)) {
+      ret = data_.at(key);
+    }
+    return ret;
+  }
+
+  void save(const std::string& key, const std::string& data) override {
+    data_[key] = data;
+  }
+
+ private:
+  std::unordered_map<std::string, std::string> data_;
+};
+
+struct memory_value {
+  size_t size;
+
+  size_t cpuBytes() const {
+    return size;
+  }
+
+  size_t gpuBytes() const {
+    return 2 * size;
+  }
+};
+
+struct memory_leaf {
+  static inline size_t size = 100;
+
+  auto operator()(ResourceDeps& deps, int x) {
+    return std::make_shared<memory_value>(memory_value{x * size});
+  }
+};
+
+struct benchmark_leaf {
+  auto operator()(ResourceDeps& deps, int x) {
+    return x;
+  }
+};
+
+struct fan_out {
+  auto operator()(ResourceDeps& deps, int n) {
+    std::vector<int> keys;
+    for (int i = 0; i < n; i += 1) {
+      keys.push_back(i);
+    }
+    return deps.getAll<B>(keys).then([](const std::vector<std::string>& bs) {
+      std::string ret;
+      for (const auto& b : bs) {
+        ret += b;
+      }
+      return ret;
+    });
+  }
+};
+
 struct stress_test {
   int operator()(ResourceDeps& deps, int n) {
     if (n == 0) {
@@ -246,9 +360,100 @@ TEST_CASE("Test updates", "[resources]") {
   REQUIRE(5 == resources.get<update_4>());
 }
 
+TEST_CASE("Test batch invalidation", "[resources]") {
+  Resources resources;
+  auto h3 = resources.get<H>(3);
+  auto version = [](const std::string& h) { return h.substr(0, h.find('(')); };
+  resources.invalidateMany<B>(std::vector<int>{1, 2});
+  REQUIRE(resources.generator<H>(1)->stale());
+  REQUIRE(resources.generator<H>(3)->stale());
+  REQUIRE(!resources.generator<H>(0)->stale());
+  REQUIRE(!resources.generator<B>(3)->stale());
+  REQUIRE(h3 != resources.get<H>(3));
+  REQUIRE(version(h3) != version(resources.get<H>(3)));
+  resources.invalidateMany<B>(std::vector<int>());
+  REQUIRE(!resources.generator<H>(3)->stale());
+}
+
+TEST_CASE("Test resource profiles", "[resources]") {
+  // Builds are only recorded on the timeline once enabled.
+  Resources untraced;
+  untraced.get<C>(2);
+  REQUIRE(untraced.profiler()->events().empty());
+
+  Resources resources;
+  resources.profiler()->setEnabled(true);
+  resources.get<C>(2);
+  resources.get<C>(2);
+  resources.invalidate<B>(1);
+  resources.get<C>(2);
+
+  // Check the counters of a single resource.
+  auto key = resourceHash<C>(2);
+  auto profiles = resources.profiles();
+  auto it = std::find_if(profiles.begin(), profiles.end(), [&](auto& p) {
+    return p.key == key;
+  });
+  REQUIRE(it != profiles.end());
+  REQUIRE(2 == it->builds);
+  REQUIRE(1 == it->hits);
+  REQUIRE(1 == it->misses);
+  REQUIRE(1 == it->stale_reads);
+  REQUIRE(it->value_size >= sizeof(std::string));
+
+  // Check the counters aggregated by type.
+  auto aggregates = aggregateProfiles(profiles);
+  auto& b = aggregates.at(typeid(B).name());
+  REQUIRE(3 == b.builds);
+  REQUIRE(1 == b.invalidations);
+  REQUIRE(3 == b.invalidation_fan_out);
+  int64_t histogram_builds = 0;
+  for (auto count : b.build_latency) {
+    histogram_builds += count;
+  }
+  REQUIRE(3 == histogram_builds);
+
+  // Check the exported trace includes builds and dependency edges.
+  REQUIRE(8 == resources.profiler()->events().size());
+  auto trace = resources.profiler()->chromeTrace();
+  REQUIRE(trace.find("\"ph\":\"X\"") != std::string::npos);
+  REQUIRE(trace.find("\"ph\":\"f\"") != std::string::npos);
+}
+
+TEST_CASE("Test resource memory", "[resources]") {
+  Resources resources;
+  auto memory = [&] {
+    for (const auto& memory : resources.memory()) {
+      if (memory.type == typeid(memory_leaf).name()) {
+        return memory;
+      }
+    }
+    return ResourceMemory();
+  };
+  resources.get<memory_leaf>(1);
+  resources.get<memory_leaf>(2);
+  REQUIRE(2 == memory().values);
+  REQUIRE(300 + 2 * sizeof(std::shared_ptr<int>) == memory().cpu_bytes);
+  REQUIRE(600 == memory().gpu_bytes);
+
+  // Totals follow values as they are rebuilt.
+  memory_leaf::size = 1000;
+  resources.invalidate<memory_leaf>(2);
+  resources.get<memory_leaf>(2);
+  REQUIRE(2 == memory().values);
+  REQUIRE(4200 == memory().gpu_bytes);
+
+  // Totals are published through stats in megabytes.
+  Stats stats;
+  resources.reportMemory(stats);
+  REQUIRE(stats.has("resource_cpu_mb"));
+  REQUIRE(stats.has("resource_gpu_mb"));
+  REQUIRE(stats.getAverage("resource_gpu_mb") > 0.0f);
+}
+
 TEST_CASE("Test asynchronous resources", "[resources]") {
   AsyncResources resources(
-      std::make_shared<Resources>(), std::make_shared<QueueExecutor>(10));
+      std::make_shared<Resources>(), std::make_shared<WorkStealingExecutor>());
   REQUIRE(0 == resources.get<async_1>().get());
   REQUIRE(0 == resources.get<async_2>().get());
   REQUIRE(0 == resources.get<async_3>().get());
@@ -279,9 +484,90 @@ TEST_CASE("Test asynchronous resources", "[resources]") {
   REQUIRE(5 == resources.get<async_4>().get());
 }
 
+TEST_CASE("Test asynchronous resource factories", "[resources]") {
+  auto resources = std::make_shared<Resources>();
+  REQUIRE(10 == resources->get<async_6>(10));
+  REQUIRE(10 == resources->getAsync<async_6>(10).get());
+  resources->invalidate<async_5>();
+  REQUIRE(12 == resources->getAsync<async_6>(10).get());
+
+  AsyncResources async_resources(
+      resources, std::make_shared<WorkStealingExecutor>());
+  REQUIRE(23 == async_resources.get<async_6>(20).get());
+  async_resources.invalidate<async_6>(20).get();
+  REQUIRE(24 == async_resources.get<async_6>(20).get());
+
+  // Asynchronous dependencies are subscribed like synchronous ones.
+  REQUIRE("B20:24" == async_resources.get<async_7>(20).get());
+  async_resources.invalidate<async_6>(20).get();
+  REQUIRE("B20:25" == async_resources.get<async_7>(20).get());
+}
+
+TEST_CASE("Test parallel fan out", "[resources]") {
+  // Dependencies are built inline without an executor.
+  Resources resources;
+  REQUIRE("B0B1B2" == resources.get<fan_out>(3));
+  REQUIRE("" == resources.get<fan_out>(0));
+
+  // Dependencies are built on the executor and still subscribed.
+  AsyncResources async_resources(
+      std::make_shared<Resources>(), std::make_shared<WorkStealingExecutor>(1));
+  REQUIRE("B0B1B2B3" == async_resources.get<fan_out>(4).get());
+  REQUIRE("B0B1B2B3" == async_resources.resources()->get<fan_out>(4));
+  async_resources.invalidate<B>(2).get();
+  REQUIRE(async_resources.resources()->generator<fan_out>(4)->stale());
+  REQUIRE("B0B1B2B3" == async_resources.get<fan_out>(4).get());
+}
+
+TEST_CASE("Test persistent resources", "[resources]") {
+  auto store = std::make_shared<MemoryResourceStore>();
+  auto build = [&] { return ResourcesBuilder().withStore(store).build(); };
+  {
+    auto resources = build();
+    REQUIRE("L1" == resources.get<persist_leaf>(1));
+    REQUIRE(1 == persist_leaf::builds);
+  }
+
+  // Values are restored in later runs if their dependencies are unchanged.
+  {
+    auto resources = build();
+    REQUIRE("L1" == resources.get<persist_leaf>(1));
+    REQUIRE(1 == persist_leaf::builds);
+    auto profile = resources.generator<persist_leaf>(1)->counters().profile();
+    REQUIRE(1 == profile.restores);
+
+    // Restored values are still subscribed to their dependencies.
+    persist_root_offset = 10;
+    resources.invalidate<persist_root>(1);
+    REQUIRE("L11" == resources.get<persist_leaf>(1));
+    REQUIRE(2 == persist_leaf::builds);
+  }
+
+  // Values are rebuilt in later runs if their dependencies changed.
+  persist_root_offset = 20;
+  {
+    auto resources = build();
+    REQUIRE("L21" == resources.get<persist_leaf>(1));
+    REQUIRE(3 == persist_leaf::builds);
+  }
+  persist_root_offset = 0;
+
+  // Values aren't digested at all without a store.
+  {
+    Resources resources;
+    REQUIRE("L1" == resources.get<persist_leaf>(1));
+    REQUIRE(resources.generator<persist_root>(1)->isVolatile());
+    REQUIRE(0 == resources.generator<persist_root>(1)->digest());
+  }
+
+  // Digests and store keys use a stable hash (64-bit FNV-1a).
+  REQUIRE(0xcbf29ce484222325ull == stableHash(""));
+  REQUIRE(0xaf63dc4c8601ec8cull == stableHash("a"));
+}
+
 TEST_CASE("Stress test asynchronous resources", "[resources]") {
   AsyncResources resources(
-      std::make_shared<Resources>(), std::make_shared<QueueExecutor>(10));
+      std::make_shared<Resources>(), std::make_shared<WorkStealingExecutor>());
 
   // Generate a bunch of random updates.
   std::vector<std::future<void>> futures;
@@ -298,4 +584,43 @@ TEST_CASE("Stress test asynchronous resources", "[resources]") {
   REQUIRE(102334155 == resources.get<stress_test>(40).get());
 }
 
-}  // namespace tequila
\ No newline at end of file
+// Run explicitly with: resources_test "[benchmark]"
+TEST_CASE("Benchmark resource generators", "[.][benchmark]") {
+  constexpr int kGeneratorCount = 1 << 20;
+  auto seconds = [](auto start) {
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+  };
+
+  Resources resources;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < kGeneratorCount; i += 1) {
+    resources.generator<benchmark_leaf>(i);
+  }
+  auto create_seconds = seconds(start);
+
+  start = std::chrono::high_resolution_clock::now();
+  int64_t sum = 0;
+  for (int i = 0; i < kGeneratorCount; i += 1) {
+    sum += resources.generator<benchmark_leaf>(i)->key() & 1;
+  }
+  auto lookup_seconds = seconds(start);
+
+  start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < kGeneratorCount; i += 1) {
+    sum += resources.get<benchmark_leaf>(i);
+  }
+  auto build_seconds = seconds(start);
+  REQUIRE(sum > 0);
+
+  std::cout << format(
+                   "generators=%1% create=%2$.3fs lookup=%3$.3fs "
+                   "build=%4$.3fs",
+                   kGeneratorCount,
+                   create_seconds,
+                   lookup_seconds,
+                   build_seconds)
+            << std::endl;
+}
+
+}  // namespace tequila
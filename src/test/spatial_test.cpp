@@ -5,6 +5,7 @@
 #include <iostream>
 #include <random>
 
+#include "src/common/data.hpp"
 #include "src/common/images.hpp"
 #include "src/common/spatial.hpp"
 
@@ -100,4 +101,85 @@ TEST_CASE("Test basic usage", "[octree]") {
       UnorderedEquals<int64_t>({0, 6, 53}));
 }
 
+TEST_CASE("Test visitor queries", "[octree]") {
+  Octree octree(2, 8);
+  auto box_distance = [&](int64_t cell, float x, float y, float z) {
+    auto [x0, y0, z0, x1, y1, z1] = octree.cellBox(cell);
+    auto dx = std::max({x0 - x, 0.0f, x - x1});
+    auto dy = std::max({y0 - y, 0.0f, y - y1});
+    auto dz = std::max({z0 - z, 0.0f, z - z1});
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+  };
+
+  // Cells round trip through their boxes.
+  for (int64_t cell = 0; cell < octree.cellCount(); cell += 1) {
+    auto [x0, y0, z0, x1, y1, z1] = octree.cellBox(cell);
+    REQUIRE(cell == octree.cellAt(octree.cellLevel(cell), x0, y0, z0));
+  }
+
+  // Sphere queries match a brute force search.
+  std::vector<int64_t> cells;
+  octree.intersectSphere({3.0f, 5.0f, 7.5f}, 2.5f, [&](int64_t cell) {
+    cells.push_back(cell);
+  });
+  std::vector<int64_t> expected;
+  for (int64_t cell = 0; cell < octree.cellCount(); cell += 1) {
+    if (box_distance(cell, 3.0f, 5.0f, 7.5f) <= 2.5f) {
+      expected.push_back(cell);
+    }
+  }
+  std::sort(cells.begin(), cells.end());
+  REQUIRE(cells == expected);
+
+  // Ray queries visit the cells along the ray including its leaves.
+  cells.clear();
+  octree.intersectRay(
+      {0.5f, 0.5f, 0.5f},
+      {1.0f, 0.0f, 0.0f},
+      100.0f,
+      [&](int64_t cell, float t) {
+        auto [x0, y0, z0, x1, y1, z1] = octree.cellBox(cell);
+        REQUIRE(y0 == 0);
+        REQUIRE(z0 == 0);
+        REQUIRE(t == std::max(0.0f, x0 - 0.5f));
+        cells.push_back(cell);
+      });
+  REQUIRE(cells.size() == 1 + 2 + 4 + 8);
+}
+
+TEST_CASE("Test occupancy summaries", "[octree]") {
+  Octree octree(1, 4);
+  REQUIRE(9 == octree.cellAt(2, 0, 0, 0));
+  REQUIRE(31 == octree.cellAt(2, 0, 3, 1));
+  REQUIRE(53 == octree.cellAt(2, 2, 0, 3));
+  REQUIRE(6 == octree.cellAt(1, 2, 0, 3));
+
+  // Summaries start out mixed until the deepest level is set.
+  OctreeOccupancy occupancy(octree, 2);
+  REQUIRE(occupancy.get(0) == Occupancy::MIXED);
+  for (int64_t cell = 9; cell < 73; cell += 1) {
+    occupancy.set(cell, Occupancy::EMPTY);
+  }
+  REQUIRE(occupancy.get(0) == Occupancy::EMPTY);
+  REQUIRE(occupancy.get(1) == Occupancy::EMPTY);
+
+  // Ancestors of a filled cell become mixed.
+  REQUIRE(occupancy.set(9, Occupancy::FULL));
+  REQUIRE(!occupancy.set(9, Occupancy::FULL));
+  REQUIRE(occupancy.get(0) == Occupancy::MIXED);
+  REQUIRE(occupancy.get(1) == Occupancy::MIXED);
+  REQUIRE(occupancy.get(2) == Occupancy::EMPTY);
+  REQUIRE(occupancy.get(9) == Occupancy::FULL);
+  for (int64_t cell = 10; cell < 17; cell += 1) {
+    occupancy.set(cell, Occupancy::FULL);
+  }
+  REQUIRE(occupancy.get(1) == Occupancy::FULL);
+
+  // Summaries survive serialization.
+  auto copy = deserialize<OctreeOccupancy>(serialize(occupancy));
+  REQUIRE(copy.level() == 2);
+  REQUIRE(copy.get(1) == Occupancy::FULL);
+  REQUIRE(copy.get(2) == Occupancy::EMPTY);
+}
+
 }  // namespace tequila
\ No newline at end of file
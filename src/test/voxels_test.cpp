@@ -0,0 +1,47 @@
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "src/common/voxels.hpp"
+
+namespace tequila {
+
+TEST_CASE("Basic usage", "[compact_vector]") {
+  VoxelArray va;
+  va.set(1, 1, 1, 1);
+  va.set(1, 1, 2, 1);
+  va.set(1, 1, 3, 1);
+  va.set(1, 1, 4, 1);
+  REQUIRE(va.get(1, 1, 0) == 0);
+  REQUIRE(va.get(1, 1, 1) == 1);
+  REQUIRE(va.get(1, 1, 2) == 1);
+  REQUIRE(va.get(1, 1, 3) == 1);
+  REQUIRE(va.get(1, 1, 4) == 1);
+  REQUIRE(va.get(1, 1, 5) == 0);
+}
+
+TEST_CASE("Downsample voxels", "[voxels]") {
+  CubeStore<uint32_t> voxels(4, 0);
+
+  // A coarse voxel with a majority value.
+  voxels.set(0, 0, 0, 1);
+  voxels.set(1, 0, 0, 2);
+  voxels.set(0, 1, 0, 2);
+  voxels.set(1, 1, 0, 2);
+
+  // A coarse voxel with too few filled voxels.
+  voxels.set(2, 2, 2, 3);
+  voxels.set(3, 3, 3, 3);
+  voxels.set(2, 3, 2, 3);
+
+  auto coarse = downsampleVoxels(voxels);
+  REQUIRE(coarse.size() == 2);
+  REQUIRE(coarse.get(0, 0, 0) == 2);
+  REQUIRE(coarse.get(1, 1, 1) == 0);
+  REQUIRE(downsampleVoxels(coarse).get(0, 0, 0) == 0);
+}
+
+}  // namespace tequila
\ No newline at end of file
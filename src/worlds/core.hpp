@@ -3,6 +3,7 @@
 #include <cereal/archives/json.hpp>
 #include <glm/glm.hpp>
 
+#include <cstring>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -15,6 +16,7 @@
 #include "src/common/resources.hpp"
 #include "src/common/spatial.hpp"
 #include "src/common/stats.hpp"
+#include "src/common/strings.hpp"
 #include "src/worlds/opengl.hpp"
 
 namespace tequila {
@@ -23,15 +25,41 @@ struct OpenGLExecutor : public SeedResource<
                             OpenGLExecutor,
                             std::shared_ptr<OpenGLContextExecutor>> {};
 
-struct WorldStats : public SeedResource<WorldStats, std::shared_ptr<Stats>> {};
+struct OpenGLUploader : public SeedResource<
+                            OpenGLUploader,
+                            std::shared_ptr<OpenGLUploadExecutor>> {};
 
-struct WorldName : public SeedResource<WorldName, std::string> {};
+// Stats never change the values of derived resources so they're digested as a
+// constant. Digests let persisted resources outlive the process.
+struct WorldStats : public SeedResource<WorldStats, std::shared_ptr<Stats>> {
+  static uint64_t digest(const std::shared_ptr<Stats>& stats) {
+    return 0;
+  }
+};
+
+// The world configuration (e.g. WorldTable, WorldOctree and VoxelConfig) is
+// derived from the world name and so digested through it.
+struct WorldName : public SeedResource<WorldName, std::string> {
+  static uint64_t digest(const std::string& name) {
+    return stableHash(name);
+  }
+};
 
 struct WorldCamera : public SeedResource<WorldCamera, std::shared_ptr<Camera>> {
 };
 
 struct WorldLight
-    : public SeedResource<WorldLight, std::shared_ptr<glm::vec3>> {};
+    : public SeedResource<WorldLight, std::shared_ptr<glm::vec3>> {
+  static uint64_t digest(const std::shared_ptr<glm::vec3>& light) {
+    uint64_t ret = stableHash("");
+    for (int i = 0; i < 3; i += 1) {
+      uint32_t bits;
+      std::memcpy(&bits, &(*light)[i], sizeof(bits));
+      ret = stableHashCombine(ret, bits);
+    }
+    return ret;
+  }
+};
 
 struct WorldTable {
   auto operator()(ResourceDeps& deps) {
@@ -48,13 +76,4 @@ struct WorldOctree {
   }
 };
 
-struct VisibleCells {
-  auto operator()(ResourceDeps& deps) {
-    auto octree = deps.get<WorldOctree>();
-    auto camera = deps.get<WorldCamera>();
-    auto cells = computeVisibleCells(*camera, *octree);
-    return std::make_shared<std::vector<int64_t>>(std::move(cells));
-  }
-};
-
 }  // namespace tequila
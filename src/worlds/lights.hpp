@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cereal/types/array.hpp>
 #include <glm/glm.hpp>
 
 #include <memory>
@@ -15,6 +16,15 @@
 #include "src/worlds/core.hpp"
 #include "src/worlds/voxels.hpp"
 
+namespace glm {
+
+template <typename Archive>
+void serialize(Archive& archive, vec3& v) {
+  archive(v.x, v.y, v.z);
+}
+
+}  // namespace glm
+
 namespace tequila {
 
 constexpr auto kMaxPositionLights = 4;
@@ -70,11 +80,16 @@ auto getVertexAmbientOcclusion(uint8_t occlusion_mask) {
 struct VertexLightData {
   float global_occlusion;
   std::array<glm::vec3, kMaxPositionLights> lights;
+
+  template <typename Archive>
+  void serialize(Archive& archive) {
+    archive(global_occlusion, lights);
+  }
 };
 
 class VertexLightMap {
  public:
-  VertexLightMap(size_t voxel_size) : size_(voxel_size + 1) {}
+  VertexLightMap(size_t voxel_size = 0) : size_(voxel_size + 1) {}
 
   bool has(int x, int y, int z) {
     return map_.count(x + y * size_ + z * size_ * size_);
@@ -88,6 +103,57 @@ class VertexLightMap {
     return map_.at(x + y * size_ + z * size_ * size_);
   }
 
+  // Returns the map of a level of detail where voxels span scale voxels of
+  // this map. Each coarse vertex averages the lights of the fine vertices
+  // nearest to it so that lighting stays consistent across levels.
+  VertexLightMap downsample(int scale) const {
+    int coarse_size = (size_ - 1) / scale;
+    VertexLightMap ret(coarse_size);
+    std::unordered_map<int, int> counts;
+    for (const auto& [index, light] : map_) {
+      int x = index % size_;
+      int y = index / size_ % size_;
+      int z = index / size_ / size_;
+      auto cx = (x + scale / 2) / scale;
+      auto cy = (y + scale / 2) / scale;
+      auto cz = (z + scale / 2) / scale;
+      auto coarse_index = cx + cy * ret.size_ + cz * ret.size_ * ret.size_;
+      auto& coarse = ret.map_[coarse_index];
+      auto count = counts[coarse_index]++;
+      coarse.global_occlusion =
+          (count * coarse.global_occlusion + light.global_occlusion) /
+          (count + 1);
+      for (size_t i = 0; i < coarse.lights.size(); i += 1) {
+        coarse.lights[i] =
+            (static_cast<float>(count) * coarse.lights[i] + light.lights[i]) /
+            static_cast<float>(count + 1);
+      }
+    }
+    return ret;
+  }
+
+  // Estimates the map's memory assuming a node and bucket pointer per entry.
+  size_t cpuBytes() const {
+    using Node = std::pair<const int, VertexLightData>;
+    return sizeof(*this) + map_.size() * (sizeof(Node) + sizeof(void*)) +
+        map_.bucket_count() * sizeof(void*);
+  }
+
+  template <typename Archive>
+  void save(Archive& archive) const {
+    std::vector<std::pair<int, VertexLightData>> entries(
+        map_.begin(), map_.end());
+    archive(size_, entries);
+  }
+
+  template <typename Archive>
+  void load(Archive& archive) {
+    std::vector<std::pair<int, VertexLightData>> entries;
+    archive(size_, entries);
+    map_.clear();
+    map_.insert(entries.begin(), entries.end());
+  }
+
  private:
   size_t size_;
   std::unordered_map<int, VertexLightData> map_;
@@ -95,6 +161,8 @@ class VertexLightMap {
 
 // Maps a voxel array to light rays at each surface vertex.
 struct VertexLights {
+  static constexpr bool kPersistent = true;
+
   auto operator()(ResourceDeps& deps, int voxel_key) {
     StatsTimer timer(deps.get<WorldStats>(), "vertex_lights");
 
@@ -158,4 +226,15 @@ struct VertexLights {
   }
 };
 
+// Downsamples the vertex lights of a voxel array for a level of detail (see
+// LODVoxels).
+struct LODVertexLights {
+  auto operator()(ResourceDeps& deps, int voxel_key, int level) {
+    ENFORCE(level > 0);
+    StatsTimer timer(deps.get<WorldStats>(), "lod_vertex_lights");
+    auto lights = deps.get<VertexLights>(voxel_key);
+    return std::make_shared<VertexLightMap>(lights->downsample(1 << level));
+  }
+};
+
 }  // namespace tequila
\ No newline at end of file
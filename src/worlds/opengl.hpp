@@ -1,10 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <functional>
 #include <future>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include "src/common/concurrency.hpp"
 #include "src/common/errors.hpp"
@@ -15,58 +18,216 @@
 
 namespace tequila {
 
-static constexpr auto kProcessThrottleDuration = std::chrono::milliseconds(5);
+// Queued OpenGL tasks are processed in priority order, e.g. so that terrain
+// near the camera is uploaded before UI rebuilds.
+enum class OpenGLTaskPriority { HIGH = 0, NORMAL = 1, LOW = 2 };
+
+static constexpr size_t kOpenGLTaskPriorities = 3;
+
+// Adapts the time spent processing OpenGL tasks each frame. The budget grows
+// while tasks are backed up and frames keep up with the vsync target and is
+// halved when a frame misses it because of the OpenGL tasks. Frames missed
+// for other reasons (e.g. IO or a vsync miss) leave the budget unchanged.
+class OpenGLTaskBudget {
+ public:
+  static constexpr double kMinSeconds = 0.0005;
+  static constexpr double kMaxFrameFraction = 0.75;
+  static constexpr double kGrowthFrameFraction = 0.02;
+  static constexpr double kMissedFrameTolerance = 1.25;
+  static constexpr double kOverrunWorkFraction = 0.25;
+  static constexpr double kShrinkFactor = 0.5;
+
+  OpenGLTaskBudget(double seconds = 0.005) : seconds_(seconds) {}
+
+  double seconds() const {
+    return seconds_;
+  }
+
+  // Updates the budget from the last frame's duration, the time it spent on
+  // OpenGL tasks and the number of tasks still queued at its end.
+  void update(
+      double target_frame_seconds,
+      double frame_seconds,
+      double work_seconds,
+      size_t queue_depth) {
+    auto max_seconds = kMaxFrameFraction * target_frame_seconds;
+    if (frame_seconds > kMissedFrameTolerance * target_frame_seconds) {
+      auto overrun = frame_seconds - target_frame_seconds;
+      if (work_seconds >= kOverrunWorkFraction * overrun) {
+        seconds_ *= kShrinkFactor;
+      }
+    } else if (queue_depth > 0) {
+      // Grow faster the deeper the backlog (e.g. during loading).
+      auto growth = kGrowthFrameFraction * target_frame_seconds;
+      seconds_ += growth * std::min<double>(1 + queue_depth / 64, 4);
+    }
+    seconds_ = std::clamp(seconds_, kMinSeconds, max_seconds);
+  }
+
+ private:
+  double seconds_;
+};
 
 class OpenGLContextExecutor {
  public:
+  using Clock = std::chrono::steady_clock;
+  using Seconds = std::chrono::duration<double>;
+
   OpenGLContextExecutor(
       std::shared_ptr<Stats> stats, std::shared_ptr<Window> window)
       : stats_(std::move(stats)), window_(std::move(window)) {}
 
   template <typename Function>
-  auto manage(Function&& fn) {
-    return runInOpenGLContext([&] {
-      using Value = std::decay_t<decltype(*fn())>;
-      return std::shared_ptr<Value>(fn(), [this](Value* obj) {
-        runInOpenGLContext([obj] { delete obj; });
-      });
-    });
+  auto manage(
+      Function&& fn,
+      OpenGLTaskPriority priority = OpenGLTaskPriority::NORMAL) {
+    return runInOpenGLContext([&] { return makeManaged(fn()); }, priority);
   }
 
+  // Like manage but returns immediately with a result that is fulfilled once
+  // the object has been created on the OpenGL thread. The function is moved
+  // into the task so it must not capture the caller's stack by reference.
   template <typename Function>
-  auto runInOpenGLContext(Function&& fn) {
+  auto manageAsync(
+      Function fn, OpenGLTaskPriority priority = OpenGLTaskPriority::NORMAL) {
+    return runInOpenGLContextAsync(
+        [this, fn = std::move(fn)] { return makeManaged(fn()); }, priority);
+  }
+
+  template <typename Function>
+  auto runInOpenGLContext(
+      Function&& fn,
+      OpenGLTaskPriority priority = OpenGLTaskPriority::NORMAL) {
     if (window_->inContext()) {
       return fn();
     } else {
       std::promise<decltype(fn())> promise;
       auto future = promise.get_future();
-      queue_.push(makeTask(promise, std::forward<Function>(fn)));
+      push(priority, makeTask(promise, std::forward<Function>(fn)));
       return future.get();
     }
   }
 
+  // Queues the function on the OpenGL thread without blocking the caller.
+  template <typename Function>
+  auto runInOpenGLContextAsync(
+      Function fn, OpenGLTaskPriority priority = OpenGLTaskPriority::NORMAL) {
+    using Value = decltype(fn());
+    AsyncResult<Value> ret;
+    if (window_->inContext()) {
+      fulfill(ret, fn);
+    } else {
+      push(priority, [ret, fn = std::move(fn)]() mutable { fulfill(ret, fn); });
+    }
+    return ret;
+  }
+
+  // Processes queued tasks within the frame's budget (see OpenGLTaskBudget).
+  // At least one task is processed per call so that progress is guaranteed.
   void process() {
     StatsTimer process_timer(stats_, "process_gl_tasks");
     ENFORCE(window_->inContext());
-    auto prev = std::chrono::high_resolution_clock::now();
-    while (!queue_.isEmpty()) {
-      auto task = queue_.pop().get();
+    auto start = Clock::now();
+    if (previous_start_ != Clock::time_point()) {
+      budget_.update(
+          1.0 / window_->refreshRate(),
+          Seconds(start - previous_start_).count(),
+          previous_work_seconds_,
+          size());
+    }
+    previous_start_ = start;
+
+    std::array<double, kOpenGLTaskPriorities> latencies{};
+    std::array<int, kOpenGLTaskPriorities> counts{};
+    auto budget = std::chrono::duration_cast<Clock::duration>(
+        Seconds(budget_.seconds()));
+    while (auto task = tryPop()) {
+      auto priority = static_cast<size_t>(task->priority);
+      auto latency = Seconds(Clock::now() - task->queue_time).count();
+      latencies[priority] = std::max(latencies[priority], latency);
+      counts[priority] += 1;
       {
         StatsTimer task_timer(stats_, "gl_task");
-        task();
+        task->fn();
       }
-      auto curr = std::chrono::high_resolution_clock::now();
-      if (curr - prev > kProcessThrottleDuration) {
+      if (Clock::now() - start > budget) {
         break;
       }
     }
+    previous_work_seconds_ = Seconds(Clock::now() - start).count();
+
+    StatsUpdate stats(stats_);
+    stats["gl_task_budget"] = budget_.seconds();
+    stats["gl_queue_depth"] = size();
+    for (size_t i = 0; i < kOpenGLTaskPriorities; i += 1) {
+      if (counts[i]) {
+        stats[format("gl_queue_latency/%1%", kPriorityNames[i])] = latencies[i];
+      }
+    }
   }
 
   bool isEmpty() {
-    return queue_.isEmpty();
+    return size() == 0;
+  }
+
+  size_t size() {
+    size_t ret = 0;
+    for (auto& queue : queues_) {
+      ret += queue.size();
+    }
+    return ret;
+  }
+
+  // Wraps the object so that it is deleted on the OpenGL thread. Deletion is
+  // queued without waiting since nothing depends on its completion.
+  template <typename Value>
+  std::shared_ptr<Value> makeManaged(Value* obj) {
+    return std::shared_ptr<Value>(obj, [this](Value* obj) {
+      if (window_->inContext()) {
+        delete obj;
+      } else if (isOpen()) {
+        push(OpenGLTaskPriority::LOW, [obj] { delete obj; });
+      }
+    });
   }
 
  private:
+  static constexpr const char* kPriorityNames[] = {"high", "normal", "low"};
+
+  struct Task {
+    std::function<void()> fn;
+    OpenGLTaskPriority priority;
+    Clock::time_point queue_time;
+  };
+
+  template <typename Function>
+  void push(OpenGLTaskPriority priority, Function&& fn) {
+    queues_.at(static_cast<size_t>(priority))
+        .push(Task{std::forward<Function>(fn), priority, Clock::now()});
+  }
+
+  boost::optional<Task> tryPop() {
+    for (auto& queue : queues_) {
+      if (auto task = queue.tryPop()) {
+        return task;
+      }
+    }
+    return boost::none;
+  }
+
+  bool isOpen() {
+    return queues_.front().isOpen();
+  }
+
+  template <typename Value, typename Function>
+  static void fulfill(AsyncResult<Value>& result, Function& fn) {
+    try {
+      result.setValue(fn());
+    } catch (...) {
+      result.setException(std::current_exception());
+    }
+  }
+
   template <typename Function>
   auto makeTask(std::promise<void>& promise, Function&& fn) {
     return [&] {
@@ -82,7 +243,87 @@ class OpenGLContextExecutor {
 
   std::shared_ptr<Stats> stats_;
   std::shared_ptr<Window> window_;
+  std::array<MPMCQueue<Task>, kOpenGLTaskPriorities> queues_;
+  OpenGLTaskBudget budget_;
+  Clock::time_point previous_start_;
+  double previous_work_seconds_ = 0.0;
+};
+
+// Creates OpenGL objects (e.g. uploads meshes) on a dedicated thread with a
+// hidden context shared with the window's context so that the render thread
+// spends no time copying data. Each result is only published once a fence
+// shows its upload has completed. The objects are still deleted on the render
+// thread through the OpenGLContextExecutor.
+class OpenGLUploadExecutor {
+ public:
+  OpenGLUploadExecutor(
+      std::shared_ptr<Stats> stats,
+      std::shared_ptr<OpenGLContextExecutor> executor,
+      std::shared_ptr<Window> context)
+      : stats_(std::move(stats)),
+        executor_(std::move(executor)),
+        context_(std::move(context)),
+        thread_([this] { run(); }) {}
+
+  ~OpenGLUploadExecutor() {
+    queue_.close();
+    thread_.join();
+  }
+
+  // Returns immediately with a result that is fulfilled once the object has
+  // been created and its upload has completed. The function must return a
+  // new object and must not capture the caller's stack by reference.
+  template <typename Function>
+  auto manageAsync(Function fn) {
+    using Value = std::remove_pointer_t<decltype(fn())>;
+    AsyncResult<std::shared_ptr<Value>> ret;
+    queue_.push([this, ret, fn = std::move(fn)]() mutable {
+      try {
+        std::unique_ptr<Value> obj;
+        {
+          StatsTimer timer(stats_, "gl_upload_task");
+          obj.reset(fn());
+        }
+        waitForUpload();
+        ret.setValue(executor_->makeManaged(obj.release()));
+      } catch (...) {
+        ret.setException(std::current_exception());
+      }
+    });
+    return ret;
+  }
+
+ private:
+  void run() {
+    context_->makeContextCurrent();
+    while (auto task = queue_.pop()) {
+      (*task)();
+    }
+    context_->releaseContext();
+  }
+
+  void waitForUpload() {
+    using namespace gl;
+    constexpr GLuint64 kTimeoutNanoseconds = 1000000;
+    StatsTimer timer(stats_, "gl_upload_fence");
+    auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_UNUSED_BIT);
+    auto flags = SyncObjectMask::GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+      auto status = glClientWaitSync(fence, flags, kTimeoutNanoseconds);
+      if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        break;
+      }
+      ENFORCE(status == GL_TIMEOUT_EXPIRED);
+      flags = SyncObjectMask::GL_NONE_BIT;
+    }
+    glDeleteSync(fence);
+  }
+
+  std::shared_ptr<Stats> stats_;
+  std::shared_ptr<OpenGLContextExecutor> executor_;
+  std::shared_ptr<Window> context_;
   MPMCQueue<std::function<void()>> queue_;
+  std::thread thread_;
 };
 
 template <>
@@ -91,4 +332,12 @@ inline std::shared_ptr<OpenGLContextExecutor> gen(const Registry& registry) {
       registry.get<Stats>(), registry.get<Window>());
 }
 
+template <>
+inline std::shared_ptr<OpenGLUploadExecutor> gen(const Registry& registry) {
+  return std::make_shared<OpenGLUploadExecutor>(
+      registry.get<Stats>(),
+      registry.get<OpenGLContextExecutor>(),
+      registry.get<Window>()->makeSharedContext());
+}
+
 }  // namespace tequila
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -96,6 +97,69 @@ auto FFI_get_stat_maximum(std::shared_ptr<Stats>& stats) {
   };
 }
 
+auto FFI_get_resource_profiles(std::shared_ptr<Resources>& resources) {
+  return [resources] {
+    // Summarize the profiles by resource type, most expensive first.
+    std::vector<ResourceProfile> profiles;
+    for (auto& pair : aggregateProfiles(resources->profiles())) {
+      profiles.push_back(std::move(pair.second));
+    }
+    std::sort(profiles.begin(), profiles.end(), [](auto& a, auto& b) {
+      return a.total_build_seconds > b.total_build_seconds;
+    });
+    std::vector<std::string> ret;
+    for (const auto& profile : profiles) {
+      ret.push_back(format(
+          "%1%: builds=%2% total=%3$.3fs max=%4$.3fs hits=%5% misses=%6% "
+          "stale=%7% invalidations=%8% fan_out=%9% bytes=%10% restores=%11%",
+          profile.type,
+          profile.builds,
+          profile.total_build_seconds,
+          profile.max_build_seconds,
+          profile.hits,
+          profile.misses,
+          profile.stale_reads,
+          profile.invalidations,
+          profile.invalidation_fan_out,
+          profile.value_size,
+          profile.restores));
+    }
+    return ret;
+  };
+}
+
+auto FFI_get_resource_memory(std::shared_ptr<Resources>& resources) {
+  return [resources] {
+    // Summarize the memory by resource type, largest first.
+    auto memory = resources->memory();
+    std::sort(memory.begin(), memory.end(), [](auto& a, auto& b) {
+      return a.cpu_bytes + a.gpu_bytes > b.cpu_bytes + b.gpu_bytes;
+    });
+    std::vector<std::string> ret;
+    for (const auto& m : memory) {
+      ret.push_back(format(
+          "%1%: values=%2% cpu=%3$.2fMB gpu=%4$.2fMB",
+          m.type,
+          m.values,
+          m.cpu_bytes / (1024.0 * 1024.0),
+          m.gpu_bytes / (1024.0 * 1024.0)));
+    }
+    return ret;
+  };
+}
+
+auto FFI_set_resource_tracing(std::shared_ptr<Resources>& resources) {
+  return [resources](bool enabled) {
+    resources->profiler()->setEnabled(enabled);
+  };
+}
+
+auto FFI_write_resource_trace(std::shared_ptr<Resources>& resources) {
+  return [resources](const std::string& path) {
+    resources->profiler()->writeChromeTrace(path);
+  };
+}
+
 auto FFI_get_light_dir(std::shared_ptr<Resources>& resources) {
   return [resources] {
     auto light = resources->get<WorldLight>();
@@ -355,6 +419,15 @@ class ScriptExecutor {
     ctx.set("get_stats", wrapFFI(FFI_get_stats(stats_)));
     ctx.set("get_stat_average", wrapFFI(FFI_get_stat_average(stats_)));
     ctx.set("get_stat_maximum", wrapFFI(FFI_get_stat_maximum(stats_)));
+    ctx.set(
+        "get_resource_profiles",
+        wrapFFI(FFI_get_resource_profiles(resources_)));
+    ctx.set(
+        "get_resource_memory", wrapFFI(FFI_get_resource_memory(resources_)));
+    ctx.set(
+        "set_resource_tracing", wrapFFI(FFI_set_resource_tracing(resources_)));
+    ctx.set(
+        "write_resource_trace", wrapFFI(FFI_write_resource_trace(resources_)));
     ctx.set("get_light_dir", wrapFFI(FFI_get_light_dir(resources_)));
     ctx.set("set_light_dir", wrapFFI(FFI_set_light_dir(resources_)));
     ctx.set("get_camera_pos", wrapFFI(FFI_get_camera_pos(resources_)));
@@ -7,6 +7,7 @@
 #include <string>
 
 #include "src/common/camera.hpp"
+#include "src/common/glstate.hpp"
 #include "src/common/meshes.hpp"
 #include "src/common/registry.hpp"
 #include "src/common/resources.hpp"
@@ -109,9 +110,9 @@ class SkyRenderer {
         shader->uniform("lightness", glm::dot(glm::vec3(0, 1.0f, 0), *light));
 
         // Draw the sky box.
-        gl::glDisable(gl::GL_DEPTH_TEST);
-        sky->mesh.draw(*shader);
-        gl::glEnable(gl::GL_DEPTH_TEST);
+        glState().setDepthTest(false);
+        sky->mesh.draw();
+        glState().setDepthTest(true);
       });
     }
   }
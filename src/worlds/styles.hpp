@@ -99,6 +99,10 @@ struct TerrainStylesColorMapIndex {
       StyleIndexMap index, std::shared_ptr<TextureArray> texture_array)
       : index(std::move(index)), texture_array(std::move(texture_array)) {}
 
+  size_t gpuBytes() const {
+    return gpuSizeOf(texture_array);
+  }
+
   auto indexOrDefault(const StyleIndexKey& key) {
     const StyleIndexKey kDefaultKey(1, "top");
     return get_or(index, key, index.at(kDefaultKey));
@@ -159,6 +163,10 @@ struct TerrainStylesNormalMapIndex {
       StyleIndexMap index, std::shared_ptr<TextureArray> texture_array)
       : index(std::move(index)), texture_array(std::move(texture_array)) {}
 
+  size_t gpuBytes() const {
+    return gpuSizeOf(texture_array);
+  }
+
   auto indexOrDefault(const StyleIndexKey& key) {
     const StyleIndexKey kDefaultKey(1, "top");
     return get_or(index, key, index.at(kDefaultKey));
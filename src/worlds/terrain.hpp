@@ -2,15 +2,21 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
-#include <unordered_set>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "src/common/camera.hpp"
 #include "src/common/data.hpp"
+#include "src/common/glstate.hpp"
 #include "src/common/maps.hpp"
 #include "src/common/meshes.hpp"
+#include "src/common/occlusion.hpp"
 #include "src/common/registry.hpp"
 #include "src/common/resources.hpp"
 #include "src/common/shaders.hpp"
@@ -108,6 +114,20 @@ inline auto terrainSliceCotangent(TerrainSliceDir dir) {
   return kCotangents.at(dir);
 }
 
+// Returns whether any face of a slice within the given box can face the eye.
+// Faces lie on planes between the box bounds so a slice is back-facing if the
+// eye is behind the box's rearmost face plane, e.g. for RIGHT slices if the
+// eye is left of the box.
+inline bool isTerrainSliceFacing(
+    TerrainSliceDir dir,
+    const glm::vec3& eye,
+    const glm::vec3& box_min,
+    const glm::vec3& box_max) {
+  auto normal = terrainSliceNormal(dir);
+  auto bound = normal.x + normal.y + normal.z > 0 ? box_min : box_max;
+  return glm::dot(normal, eye - bound) > 0;
+}
+
 inline auto terrainSliceVertexOffsets(TerrainSliceDir dir) {
   static const std::vector<std::vector<std::tuple<int, int, int>>> kOffsets = {
       {
@@ -150,26 +170,112 @@ inline auto terrainSliceVertexOffsets(TerrainSliceDir dir) {
   return kOffsets.at(dir);
 }
 
-using TerrainSliceKey = std::tuple<int, TerrainSliceDir>;
+// Terrain shards are meshed at levels of detail where each level halves the
+// voxel resolution (see LODVoxels). Shards use the coarsest level at which a
+// voxel spans at most kTerrainLODMaxError of the half-height of the screen.
+constexpr int kTerrainLODLevels = 4;
+constexpr float kTerrainLODMaxError = 0.03f;
+
+// Returns the level of detail to render the box at from the camera.
+inline int terrainLODLevel(
+    const Camera& camera, const glm::vec3& box_min, const glm::vec3& box_max) {
+  auto nearest = glm::clamp(camera.position, box_min, box_max);
+  auto distance = glm::length(nearest - camera.position);
+  auto max_voxel_size =
+      kTerrainLODMaxError * distance * std::tan(camera.fov / 2);
+  int level = 0;
+  while (level + 1 < kTerrainLODLevels && (2 << level) <= max_voxel_size) {
+    level += 1;
+  }
+  return level;
+}
+
+// Returns the key of the shard adjacent to the shard in the given direction
+// or -1 if it would be outside of the grid.
+inline int terrainShardNeighbor(
+    const VoxelConfigData& config, int key, TerrainSliceDir dir) {
+  auto grid_size = config.grid_size;
+  auto normal = terrainSliceNormal(dir);
+  int nx = key % grid_size + static_cast<int>(normal[0]);
+  int ny = key / grid_size % grid_size + static_cast<int>(normal[1]);
+  int nz = key / grid_size / grid_size + static_cast<int>(normal[2]);
+  auto inside = [grid_size](int v) { return 0 <= v && v < grid_size; };
+  if (!inside(nx) || !inside(ny) || !inside(nz)) {
+    return -1;
+  }
+  return nx + ny * grid_size + nz * grid_size * grid_size;
+}
+
+// Keys a slice by its shard, direction, level of detail and whether the
+// neighboring shard in its direction is rendered at a finer level.
+using TerrainSliceKey = std::tuple<int, TerrainSliceDir, int, bool>;
 using TerrainSliceFace = std::tuple<int, int, int, int64_t>;
 
-// Computes all faces.
+// Computes all faces. Faces are located by the minimum corner of their voxel
+// in world coordinates where voxels at level L span 2^L world voxels.
 struct TerrainSliceFaces {
+  static constexpr bool kPersistent = true;
+
   auto operator()(ResourceDeps& deps, TerrainSliceKey key) {
     StatsTimer timer(deps.get<WorldStats>(), "terrain_slice_faces");
 
     auto shard_key = std::get<0>(key);
     auto shard_dir = std::get<1>(key);
+    auto level = std::get<2>(key);
+    auto finer_neighbor = std::get<3>(key);
 
     // Fetch the bounding box of this slice's terrain shard.
     auto voxel_config = deps.get<VoxelConfig>();
     auto [x0, y0, z0, x1, y1, z1] = voxel_config->voxelBox(shard_key);
+    auto normal = terrainSliceNormal(shard_dir);
+    auto faces = std::make_shared<std::vector<TerrainSliceFace>>();
+
+    // Coarse levels treat voxels outside of the shard as empty along borders
+    // with finer shards so that a skirt closes the border. This hides cracks
+    // between shards rendered at different levels. Other borders are culled
+    // against the neighbor's voxels at the same level.
+    if (level > 0) {
+      auto voxels = deps.get<LODVoxels>(shard_key, level);
+      ResourceValue<LODVoxels> neighbor;
+      auto neighbor_key =
+          terrainShardNeighbor(*voxel_config, shard_key, shard_dir);
+      if (!finer_neighbor && neighbor_key >= 0) {
+        neighbor = deps.get<LODVoxels>(neighbor_key, level);
+      }
+      int size = voxels->size();
+      int scale = 1 << level;
+      auto filled = [&](int x, int y, int z) {
+        auto inside = [size](int v) { return 0 <= v && v < size; };
+        if (inside(x) && inside(y) && inside(z)) {
+          return voxels->get(x, y, z) != 0;
+        }
+
+        // Only voxels of the neighbor in the slice direction are sampled.
+        auto wrap = [size](int v) { return (v + size) % size; };
+        return neighbor && neighbor->get(wrap(x), wrap(y), wrap(z)) != 0;
+      };
+      for (int z = 0; z < size; z += 1) {
+        for (int y = 0; y < size; y += 1) {
+          for (int x = 0; x < size; x += 1) {
+            int nx = x + static_cast<int>(normal[0]);
+            int ny = y + static_cast<int>(normal[1]);
+            int nz = z + static_cast<int>(normal[2]);
+            if (filled(x, y, z) && !filled(nx, ny, nz)) {
+              faces->emplace_back(
+                  x0 + scale * x,
+                  y0 + scale * y,
+                  z0 + scale * z,
+                  voxels->get(x, y, z));
+            }
+          }
+        }
+      }
+      return faces;
+    }
 
     // Identify surface faces for the current terrain shard.
     VoxelAccessor accessor(deps);
-    auto normal = terrainSliceNormal(shard_dir);
     auto surface_voxels = deps.get<SurfaceVoxels>(shard_key);
-    auto faces = std::make_shared<std::vector<TerrainSliceFace>>();
     for (auto [ix, iy, iz] : *surface_voxels) {
       int x = x0 + ix;
       int y = y0 + iy;
@@ -186,66 +292,42 @@ struct TerrainSliceFaces {
   }
 };
 
-struct TerrainSliceData {
-  Mesh mesh;
-  glm::vec3 normal;
-  glm::vec3 tangent;
-  glm::vec3 cotangent;
-  std::shared_ptr<TextureArray> color_map;
-  std::shared_ptr<TextureArray> normal_map;
-
-  TerrainSliceData(
-      Mesh mesh,
-      glm::vec3 normal,
-      glm::vec3 tangent,
-      glm::vec3 cotangent,
-      std::shared_ptr<TextureArray> color_map,
-      std::shared_ptr<TextureArray> normal_map)
-      : mesh(std::move(mesh)),
-        normal(std::move(normal)),
-        tangent(std::move(tangent)),
-        cotangent(std::move(cotangent)),
-        color_map(std::move(color_map)),
-        normal_map(std::move(normal_map)) {}
-
-  auto modelViewMatrix(const Camera& camera) {
-    return camera.viewMatrix() * mesh.transform();
+// Packs the vertices of a terrain shard's slices into one vertex buffer so
+// that the shard is drawn with a single multi-draw call. The slice direction
+// is stored in each vertex in place of per-slice uniforms.
+class TerrainShardMesher {
+ public:
+  // Fetches the resources needed to mesh the shard up front so that meshing
+  // can continue once the shard's faces are ready. Coarse shards use vertex
+  // lights downsampled from the full resolution ones.
+  TerrainShardMesher(ResourceDeps& deps, int shard_key, int level)
+      : terrain_styles_(deps.get<TerrainStyles>()),
+        color_maps_(deps.get<TerrainStylesColorMap>()),
+        normal_maps_(deps.get<TerrainStylesNormalMap>()),
+        vertex_lights_(
+            level ? deps.get<LODVertexLights>(shard_key, level)
+                  : deps.get<VertexLights>(shard_key)),
+        scale_(1 << level) {
+    auto [x0, y0, z0, x1, y1, z1] =
+        deps.get<VoxelConfig>()->voxelBox(shard_key);
+    origin_ = {x0, y0, z0};
   }
 
-  auto normalMatrix(const Camera& camera) {
-    return glm::inverse(glm::transpose(glm::mat3(modelViewMatrix(camera))));
+  void reserve(int faces) {
+    size_ = 6 * faces;
+    positions_.resize(3, size_);
+    colors_.resize(3, size_);
+    indices_.resize(2, size_);
+    lights_.resize(3, size_);
   }
-};
 
-// Creates the mesh of a terrain slice at a given size.
-struct TerrainSlice {
-  auto operator()(ResourceDeps& deps, TerrainSliceKey key) {
-    // Load the faces for this slice.
-    auto faces = deps.get<TerrainSliceFaces>(key);
-    if (faces->empty()) {
-      return std::shared_ptr<TerrainSliceData>();
-    }
-
-    StatsTimer timer(deps.get<WorldStats>(), "terrain_slice");
-
-    // Look up the texture maps for this face since we need to specify
-    // vertex attributes to point each face to its corresponding texture
-    // map indices.
-    auto terrain_styles = deps.get<TerrainStyles>();
-    auto color_maps = deps.get<TerrainStylesColorMap>();
-    auto normal_maps = deps.get<TerrainStylesNormalMap>();
-
-    // Fetch the bounding box of this slice's terrain shard.
-    auto shard_key = std::get<0>(key);
-    auto voxel_config = deps.get<VoxelConfig>();
-    auto [x0, y0, z0, x1, y1, z1] = voxel_config->voxelBox(shard_key);
-
-    // Look up vertex lighting information for this slice's faces.
-    auto vertex_lights = deps.get<VertexLights>(shard_key);
+  // Appends the vertices of a slice's faces and returns the slice's range.
+  std::tuple<int, int> addSlice(
+      TerrainSliceDir dir, const std::vector<TerrainSliceFace>& faces) {
+    auto [x0, y0, z0] = origin_;
+    auto first = offset_;
 
     // Look up the surface vectors for the current direction.
-    auto dir = std::get<1>(key);
-    auto nor = terrainSliceNormal(dir);
     auto tan = terrainSliceTangent(dir);
     auto cot = terrainSliceCotangent(dir);
     auto pos = terrainSliceOrigin(dir);
@@ -262,6 +344,7 @@ struct TerrainSlice {
     dir_face.row(0) += pos[0] * ones_row;
     dir_face.row(1) += pos[1] * ones_row;
     dir_face.row(2) += pos[2] * ones_row;
+    dir_face *= scale_;
 
     // Prepare vertex index deltas the each face
     auto vertex_offsets = terrainSliceVertexOffsets(dir);
@@ -271,165 +354,529 @@ struct TerrainSlice {
     auto [x_11, y_11, z_11] = vertex_offsets.at(3);
 
     // Construct the mesh's vertex attribute array.
-    Eigen::Matrix<float, 3, Eigen::Dynamic> positions(3, 6 * faces->size());
-    Eigen::Matrix<float, 3, Eigen::Dynamic> colors(3, 6 * faces->size());
-    Eigen::Matrix<float, 2, Eigen::Dynamic> indices(2, 6 * faces->size());
-    Eigen::Matrix<float, 3, Eigen::Dynamic> lights(3, 6 * faces->size());
-    for (int i = 0; i < faces->size(); i += 1) {
-      auto [fx, fy, fz, style] = faces->at(i);
-      auto vx = fx - x0, vy = fy - y0, vz = fz - z0;
+    for (const auto& [fx, fy, fz, style] : faces) {
+      auto vx = (fx - x0) / scale_;
+      auto vy = (fy - y0) / scale_;
+      auto vz = (fz - z0) / scale_;
 
       // Positions.
-      positions.row(0).segment(6 * i, 6) = fx * ones_row + dir_face.row(0);
-      positions.row(1).segment(6 * i, 6) = fy * ones_row + dir_face.row(1);
-      positions.row(2).segment(6 * i, 6) = fz * ones_row + dir_face.row(2);
+      positions_.row(0).segment(offset_, 6) = fx * ones_row + dir_face.row(0);
+      positions_.row(1).segment(offset_, 6) = fy * ones_row + dir_face.row(1);
+      positions_.row(2).segment(offset_, 6) = fz * ones_row + dir_face.row(2);
 
       // Colors.
-      if (auto style_ptr = get_ptr(terrain_styles->styles, style)) {
+      if (auto style_ptr = get_ptr(terrain_styles_->styles, style)) {
         auto rgba = style_ptr->colorVec();
-        colors.row(0).segment(6 * i, 6) = rgba[0] * ones_row;
-        colors.row(1).segment(6 * i, 6) = rgba[1] * ones_row;
-        colors.row(2).segment(6 * i, 6) = rgba[2] * ones_row;
+        colors_.row(0).segment(offset_, 6) = rgba[0] * ones_row;
+        colors_.row(1).segment(offset_, 6) = rgba[1] * ones_row;
+        colors_.row(2).segment(offset_, 6) = rgba[2] * ones_row;
       } else {
-        colors.block<3, 6>(0, 6 * i).setOnes();
+        colors_.block<3, 6>(0, offset_).setOnes();
       }
 
-      // Lights.
+      // Lights and slice direction.
       // HACK: These lights are inappropriately shoved into normal coords.
       // TODO: Refactor mesh library into vertex buffer wrapper that
       // supports arbitrarily packed and typed vertex attributes.
-      auto light_00 = vertex_lights->at(vx + x_00, vy + y_00, vz + z_00);
-      auto light_01 = vertex_lights->at(vx + x_01, vy + y_01, vz + z_01);
-      auto light_10 = vertex_lights->at(vx + x_10, vy + y_10, vz + z_10);
-      auto light_11 = vertex_lights->at(vx + x_11, vy + y_11, vz + z_11);
-      lights(0, 6 * i) = light_00.global_occlusion;
-      lights(0, 6 * i + 1) = light_01.global_occlusion;
-      lights(0, 6 * i + 2) = light_11.global_occlusion;
-      lights(0, 6 * i + 3) = light_11.global_occlusion;
-      lights(0, 6 * i + 4) = light_10.global_occlusion;
-      lights(0, 6 * i + 5) = light_00.global_occlusion;
+      auto light_00 = globalOcclusion(vx + x_00, vy + y_00, vz + z_00);
+      auto light_01 = globalOcclusion(vx + x_01, vy + y_01, vz + z_01);
+      auto light_10 = globalOcclusion(vx + x_10, vy + y_10, vz + z_10);
+      auto light_11 = globalOcclusion(vx + x_11, vy + y_11, vz + z_11);
+      lights_(0, offset_) = light_00;
+      lights_(0, offset_ + 1) = light_01;
+      lights_(0, offset_ + 2) = light_11;
+      lights_(0, offset_ + 3) = light_11;
+      lights_(0, offset_ + 4) = light_10;
+      lights_(0, offset_ + 5) = light_00;
+      lights_.row(1).segment(offset_, 6) = static_cast<float>(dir) * ones_row;
+      lights_.row(2).segment(offset_, 6).setZero();
 
       // Texture map layer indices.
       // HACK: These indices are inappropriately shoved into texture coords.
       // TODO: Refactor mesh library into vertex buffer wrapper that supports
       // arbitrarily packed and typed vertex attributes.
       auto style_index_key = terrainSliceStyleKey(style, dir);
-      auto color_index = color_maps->indexOrDefault(style_index_key);
-      auto normal_index = normal_maps->indexOrDefault(style_index_key);
-      indices.row(0).segment(6 * i, 6) = color_index * ones_row;
-      indices.row(1).segment(6 * i, 6) = normal_index * ones_row;
+      auto color_index = color_maps_->indexOrDefault(style_index_key);
+      auto normal_index = normal_maps_->indexOrDefault(style_index_key);
+      indices_.row(0).segment(offset_, 6) = color_index * ones_row;
+      indices_.row(1).segment(offset_, 6) = normal_index * ones_row;
+
+      offset_ += 6;
     }
+    return {first, offset_ - first};
+  }
 
-    // Set the final slice data.
-    // NOTE: We need to execute this within the OpenGL context.
-    return deps.get<OpenGLExecutor>()->manage([&] {
-      return new TerrainSliceData(
-          MeshBuilder()
-              .setPositions(std::move(positions))
-              .setColors(std::move(colors))
-              .setTexCoords(std::move(indices))
-              .setNormals(std::move(lights))
-              .build(),
-          std::move(nor),
-          std::move(tan),
-          std::move(cot),
-          color_maps->texture_array,
-          normal_maps->texture_array);
-    });
+  // Returns a builder for the packed mesh. The builder is shared so that it
+  // can be moved into an upload task.
+  auto builder() {
+    ENFORCE(offset_ == size_);
+    auto ret = std::make_shared<MeshBuilder>();
+    ret->setPositions(std::move(positions_))
+        .setColors(std::move(colors_))
+        .setTexCoords(std::move(indices_))
+        .setNormals(std::move(lights_));
+    return ret;
+  }
+
+ private:
+  // Coarse vertices may not be near any full resolution surface vertex in
+  // which case they're treated as unoccluded.
+  float globalOcclusion(int x, int y, int z) {
+    return vertex_lights_->has(x, y, z)
+        ? vertex_lights_->at(x, y, z).global_occlusion
+        : 1.0f;
   }
+
+  ResourceValue<TerrainStyles> terrain_styles_;
+  ResourceValue<TerrainStylesColorMap> color_maps_;
+  ResourceValue<TerrainStylesNormalMap> normal_maps_;
+  ResourceValue<VertexLights> vertex_lights_;
+  std::tuple<int, int, int> origin_;
+  int scale_;
+  int size_ = 0;
+  int offset_ = 0;
+  Eigen::Matrix<float, 3, Eigen::Dynamic> positions_;
+  Eigen::Matrix<float, 3, Eigen::Dynamic> colors_;
+  Eigen::Matrix<float, 2, Eigen::Dynamic> indices_;
+  Eigen::Matrix<float, 3, Eigen::Dynamic> lights_;
 };
 
+// The slices of a terrain shard packed into one mesh. Its vertices are in
+// world coordinates so all shards share the same modelview matrix.
 struct TerrainShardData {
-  std::vector<std::shared_ptr<TerrainSliceData>> slices;
+  Mesh mesh;
+  glm::vec3 box_min;
+  glm::vec3 box_max;
+
+  // The direction and vertex range of each non-empty slice.
+  std::vector<TerrainSliceDir> dirs;
+  std::vector<gl::GLint> firsts;
+  std::vector<gl::GLsizei> counts;
+
+  TerrainShardData(
+      Mesh mesh,
+      glm::vec3 box_min,
+      glm::vec3 box_max,
+      std::vector<TerrainSliceDir> dirs,
+      std::vector<gl::GLint> firsts,
+      std::vector<gl::GLsizei> counts)
+      : mesh(std::move(mesh)),
+        box_min(std::move(box_min)),
+        box_max(std::move(box_max)),
+        dirs(std::move(dirs)),
+        firsts(std::move(firsts)),
+        counts(std::move(counts)) {}
+
+  size_t cpuBytes() const {
+    return sizeof(*this) - sizeof(mesh) + mesh.cpuBytes() +
+        dirs.capacity() * sizeof(TerrainSliceDir) +
+        firsts.capacity() * sizeof(gl::GLint) +
+        counts.capacity() * sizeof(gl::GLsizei);
+  }
+
+  size_t gpuBytes() const {
+    return mesh.gpuBytes();
+  }
 };
 
 // A collection of terrain slices to render. It's important to aggregate slices
-// into a shard so that we can cull slices facing away from the camera and to
-// ensure that all slices within a shard display updates atomically.
+// into a shard so that we can cull slices facing away from the camera (see
+// TerrainRenderer), to ensure that all slices within a shard display updates
+// atomically and to draw them with one call. The skirts mask has a bit set for
+// each direction whose neighboring shard is rendered at a finer level.
 struct TerrainShard {
-  auto operator()(ResourceDeps& deps, int key) {
+  auto operator()(ResourceDeps& deps, int key, int level, int skirts) {
     StatsTimer timer(deps.get<WorldStats>(), "terrain_shard");
 
-    // Output all relevant slices for the given shard.
-    // TODO: Do back-face culling of slices here.
-    auto ret = std::make_shared<TerrainShardData>();
-    if (auto slice = deps.get<TerrainSlice>(TerrainSliceKey(key, LEFT))) {
-      ret->slices.push_back(slice);
+    // Compute the faces of all slices in parallel and then pack the
+    // non-empty slices into one mesh once they're ready.
+    std::vector<TerrainSliceKey> slice_keys;
+    for (auto dir : {LEFT, RIGHT, DOWN, UP, BACK, FRONT}) {
+      slice_keys.emplace_back(key, dir, level, (skirts >> dir) & 1);
     }
-    if (auto slice = deps.get<TerrainSlice>(TerrainSliceKey(key, RIGHT))) {
-      ret->slices.push_back(slice);
+    auto mesher = std::make_shared<TerrainShardMesher>(deps, key, level);
+    auto uploader = deps.get<OpenGLUploader>();
+    auto [x0, y0, z0, x1, y1, z1] = deps.get<VoxelConfig>()->voxelBox(key);
+    glm::vec3 box_min(x0, y0, z0);
+    glm::vec3 box_max(x1, y1, z1);
+    return deps.getAll<TerrainSliceFaces>(slice_keys).then(
+        [slice_keys, mesher, uploader, box_min, box_max](const auto& faces) {
+          int total_faces = 0;
+          for (const auto& slice_faces : faces) {
+            total_faces += slice_faces->size();
+          }
+          if (!total_faces) {
+            return makeReadyAsyncResult(std::shared_ptr<TerrainShardData>());
+          }
+
+          mesher->reserve(total_faces);
+          std::vector<TerrainSliceDir> dirs;
+          std::vector<gl::GLint> firsts;
+          std::vector<gl::GLsizei> counts;
+          for (size_t i = 0; i < slice_keys.size(); i += 1) {
+            if (faces.at(i)->empty()) {
+              continue;
+            }
+            auto dir = std::get<1>(slice_keys.at(i));
+            auto [first, count] = mesher->addSlice(dir, *faces.at(i));
+            dirs.push_back(dir);
+            firsts.push_back(first);
+            counts.push_back(count);
+          }
+
+          // NOTE: We need to execute this within an OpenGL context. The
+          // upload is queued on the upload thread without blocking this
+          // thread so the task captures by value.
+          return uploader->manageAsync(
+              [builder = mesher->builder(),
+               box_min,
+               box_max,
+               dirs = std::move(dirs),
+               firsts = std::move(firsts),
+               counts = std::move(counts)] {
+                return new TerrainShardData(
+                    builder->build(), box_min, box_max, dirs, firsts, counts);
+              });
+        });
+  }
+};
+
+// Conservative occluders for a terrain shard, i.e. boxes of entirely solid
+// voxels in world coordinates (see OcclusionBuffer).
+struct TerrainOccluders {
+  auto operator()(ResourceDeps& deps, int key) {
+    StatsTimer timer(deps.get<WorldStats>(), "terrain_occluders");
+    constexpr int kBlockSize = 8;
+    auto voxels = deps.get<Voxels>(key);
+    auto [x0, y0, z0, x1, y1, z1] = deps.get<VoxelConfig>()->voxelBox(key);
+    glm::vec3 offset(x0, y0, z0);
+    auto ret = std::make_shared<std::vector<std::pair<glm::vec3, glm::vec3>>>();
+    for (const auto& [lo, hi] : occluderBoxes(*voxels, kBlockSize)) {
+      ret->emplace_back(offset + glm::vec3(lo), offset + glm::vec3(hi));
     }
-    if (auto slice = deps.get<TerrainSlice>(TerrainSliceKey(key, DOWN))) {
-      ret->slices.push_back(slice);
+    return ret;
+  }
+};
+
+// The visible terrain shards added along with their levels of detail and
+// skirts (see TerrainShard) and the shards removed since the previous update.
+// Shards whose level or skirts change are both removed and added again.
+// Versions are unique across sets so that the deltas only apply on top of the
+// previous version. Snapshots of a set have no previous version and add all of
+// its shards.
+struct TerrainShardKeysUpdate {
+  uint64_t previous_version;
+  uint64_t version;
+  std::vector<std::tuple<int, int, int>> added;
+  std::vector<int> removed;
+};
+
+// Maintains the terrain shards intersecting the visible octree cells from
+// the deltas of successive VisibleCells updates by counting the visible cells
+// intersecting each shard. Shards summarized as empty are skipped. Levels of
+// detail only depend on the distance to the camera so each shard remembers how
+// far the camera may move before its level or skirts could change, and only
+// shards whose slack has run out are re-leveled.
+class TerrainShardKeySet {
+ public:
+  TerrainShardKeySet(
+      Octree octree,
+      VoxelConfigData config,
+      std::shared_ptr<const OctreeOccupancy> occupancy)
+      : octree_(std::move(octree)),
+        config_(std::move(config)),
+        occupancy_(std::move(occupancy)),
+        version_(0),
+        cells_version_(0),
+        translation_(0.0) {}
+
+  auto update(
+      const VisibleCellsUpdate& cells,
+      VisibleCellSet& visible_cells,
+      const Camera& camera) {
+    static std::atomic<uint64_t> next_version(1);
+    std::lock_guard lock(mutex_);
+    TerrainShardKeysUpdate ret{version_, next_version++};
+    version_ = ret.version;
+
+    // Accumulate how far the camera has moved in total. Changing the field of
+    // view changes all levels so start over.
+    bool relevel = !camera_ || camera_->fov != camera.fov;
+    if (!relevel) {
+      translation_ += glm::length(camera.position - camera_->position);
     }
-    if (auto slice = deps.get<TerrainSlice>(TerrainSliceKey(key, UP))) {
-      ret->slices.push_back(slice);
+    camera_ = camera;
+
+    // Apply the visible cell deltas to the shard counts.
+    std::vector<int> added_keys, removed_keys;
+    if (cells.previous_version == cells_version_) {
+      for (auto cell : cells.removed) {
+        removeCell(cell, removed_keys);
+      }
+      for (auto cell : cells.added) {
+        addCell(cell, added_keys);
+      }
+      cells_version_ = cells.version;
+    } else {
+      // Missed an update so start over from all of the visible cells.
+      auto snapshot = visible_cells.snapshot();
+      auto old_counts = std::move(counts_);
+      counts_.clear();
+      cell_keys_.clear();
+      std::vector<int> keys;
+      for (auto cell : snapshot.added) {
+        addCell(cell, keys);
+      }
+      for (auto key : keys) {
+        if (!old_counts.count(key)) {
+          added_keys.push_back(key);
+        }
+      }
+      for (const auto& [key, count] : old_counts) {
+        if (!counts_.count(key)) {
+          removed_keys.push_back(key);
+        }
+      }
+      cells_version_ = snapshot.version;
+    }
+    for (auto key : removed_keys) {
+      shards_.erase(key);
+      ret.removed.push_back(key);
+    }
+
+    // Re-level the shards whose slack has run out.
+    std::vector<int> relevel_keys;
+    if (relevel) {
+      expirations_ = {};
+      for (const auto& [key, shard] : shards_) {
+        relevel_keys.push_back(key);
+      }
+    }
+    while (expirations_.size() && expirations_.top().first <= translation_) {
+      auto [expiration, key] = expirations_.top();
+      expirations_.pop();
+      auto it = shards_.find(key);
+      if (it != shards_.end() && it->second.expiration == expiration) {
+        relevel_keys.push_back(key);
+      }
+    }
+    for (auto key : relevel_keys) {
+      auto old_shard = shards_.at(key);
+      auto shard = relevelShard(key);
+      if (std::get<1>(shard) != old_shard.level ||
+          std::get<2>(shard) != old_shard.skirts) {
+        ret.removed.push_back(key);
+        ret.added.push_back(shard);
+      }
+    }
+    for (auto key : added_keys) {
+      ret.added.push_back(relevelShard(key));
+    }
+
+    // Drop stale expirations once they outnumber the shards.
+    if (expirations_.size() > 2 * shards_.size() + kMinExpirations) {
+      expirations_ = {};
+      for (const auto& [key, shard] : shards_) {
+        expirations_.emplace(shard.expiration, key);
+      }
+    }
+    return ret;
+  }
+
+  // Returns all of the visible shards as of the latest update.
+  TerrainShardKeysUpdate snapshot() {
+    std::lock_guard lock(mutex_);
+    TerrainShardKeysUpdate ret{0, version_};
+    ret.added.reserve(shards_.size());
+    for (const auto& [key, shard] : shards_) {
+      ret.added.emplace_back(key, shard.level, shard.skirts);
     }
-    if (auto slice = deps.get<TerrainSlice>(TerrainSliceKey(key, BACK))) {
-      ret->slices.push_back(slice);
+    return ret;
+  }
+
+ private:
+  static constexpr size_t kMinExpirations = 1024;
+
+  // The level of detail and skirts of a visible shard along with the total
+  // camera translation at which they could next change.
+  struct Shard {
+    int level;
+    int skirts;
+    double expiration;
+  };
+
+  using Expiration = std::pair<double, int>;
+
+  // Returns the shard's level of detail along with the distance the camera
+  // may move before it could change, i.e. the distance to the nearest level
+  // boundary (see terrainLODLevel).
+  std::pair<int, float> shardLevel(int key) {
+    auto [x0, y0, z0, x1, y1, z1] = config_.voxelBox(key);
+    glm::vec3 box_min(x0, y0, z0), box_max(x1, y1, z1);
+    auto level = terrainLODLevel(*camera_, box_min, box_max);
+    auto nearest = glm::clamp(camera_->position, box_min, box_max);
+    auto distance = glm::length(nearest - camera_->position);
+    auto scale = kTerrainLODMaxError * std::tan(camera_->fov / 2);
+    auto slack = std::numeric_limits<float>::infinity();
+    for (int i = 1; i < kTerrainLODLevels; i += 1) {
+      slack = std::min(slack, std::abs(distance - (1 << i) / scale));
     }
-    if (auto slice = deps.get<TerrainSlice>(TerrainSliceKey(key, FRONT))) {
-      ret->slices.push_back(slice);
+    return {level, slack};
+  }
+
+  // Updates the shard's level of detail and the mask of directions whose
+  // neighboring shards are rendered at a finer level than the shard. Levels
+  // only depend on the distance to the camera so neighbors are checked whether
+  // or not they're visible, and their slack bounds that of the skirts.
+  std::tuple<int, int, int> relevelShard(int key) {
+    auto [level, slack] = shardLevel(key);
+    int skirts = 0;
+    for (auto dir : {LEFT, RIGHT, DOWN, UP, BACK, FRONT}) {
+      auto neighbor = terrainShardNeighbor(config_, key, dir);
+      if (neighbor >= 0) {
+        auto [neighbor_level, neighbor_slack] = shardLevel(neighbor);
+        slack = std::min(slack, neighbor_slack);
+        if (neighbor_level < level) {
+          skirts |= 1 << dir;
+        }
+      }
     }
+    auto expiration = translation_ + slack;
+    shards_[key] = Shard{level, skirts, expiration};
+    expirations_.emplace(expiration, key);
+    return {key, level, skirts};
+  }
+
+  // Returns the shard keys intersecting with an octree cell. Terrain shards
+  // are one-to-one with voxel array indices.
+  std::vector<int> cellKeys(int64_t cell) const {
+    auto shard_size = config_.voxel_size;
+    auto grid_size = config_.grid_size;
+    std::vector<int> ret;
+    octree_.search(
+        [&](int64_t cell) {
+          if (occupancy_->get(cell) == Occupancy::EMPTY) {
+            return false;
+          }
+          auto [x0, y0, z0, x1, y1, z1] = octree_.cellBox(cell);
+          if (x1 - x0 <= shard_size) {
+            int sx = x0 / shard_size;
+            int sy = y0 / shard_size;
+            int sz = z0 / shard_size;
+            ret.push_back(sx + sy * grid_size + sz * grid_size * grid_size);
+            return false;
+          } else {
+            return true;
+          }
+        },
+        cell);
     return ret;
   }
+
+  void addCell(int64_t cell, std::vector<int>& added_keys) {
+    auto& keys = cell_keys_[cell] = cellKeys(cell);
+    for (auto key : keys) {
+      if (counts_[key]++ == 0) {
+        added_keys.push_back(key);
+      }
+    }
+  }
+
+  void removeCell(int64_t cell, std::vector<int>& removed_keys) {
+    auto it = cell_keys_.find(cell);
+    ENFORCE(it != cell_keys_.end());
+    for (auto key : it->second) {
+      if (--counts_[key] == 0) {
+        counts_.erase(key);
+        removed_keys.push_back(key);
+      }
+    }
+    cell_keys_.erase(it);
+  }
+
+  std::mutex mutex_;
+  Octree octree_;
+  VoxelConfigData config_;
+  std::shared_ptr<const OctreeOccupancy> occupancy_;
+  uint64_t version_;
+  uint64_t cells_version_;
+  boost::optional<Camera> camera_;
+  double translation_;
+  std::unordered_map<int64_t, std::vector<int>> cell_keys_;
+  std::unordered_map<int, int> counts_;
+  std::unordered_map<int, Shard> shards_;
+  std::priority_queue<Expiration, std::vector<Expiration>, std::greater<>>
+      expirations_;
 };
 
-// Returns the keys for the terrain shards that should be rendered.
+// Outlives camera moves so that TerrainShardKeys is updated incrementally.
+struct TerrainShardKeyTracker {
+  auto operator()(ResourceDeps& deps) {
+    return std::make_shared<TerrainShardKeySet>(
+        *deps.get<WorldOctree>(),
+        *deps.get<VoxelConfig>(),
+        deps.get<WorldOccupancy>());
+  }
+};
+
+// Returns the keys and levels of detail of the terrain shards that should be
+// rendered.
 struct TerrainShardKeys {
   auto operator()(ResourceDeps& deps) {
+    StatsUpdate stats(deps.get<WorldStats>());
     StatsTimer timer(deps.get<WorldStats>(), "terrain_shard_keys");
+    auto tracker = deps.get<TerrainShardKeyTracker>();
+    auto cells = deps.get<VisibleCells>();
+    auto cell_tracker = deps.get<VisibleCellTracker>();
+    auto camera = deps.get<WorldCamera>();
+    auto update = tracker->update(*cells, *cell_tracker, *camera);
+    stats["terrain_shard_keys_added"] = update.added.size();
+    stats["terrain_shard_keys_removed"] = update.removed.size();
+    return std::make_shared<TerrainShardKeysUpdate>(std::move(update));
+  }
+};
 
-    // Terrains shards are one-to-one with voxel array indices.
-    auto octree = deps.get<WorldOctree>();
-    auto voxel_config = deps.get<VoxelConfig>();
-    auto shard_size = voxel_config->voxel_size;
-    auto grid_size = voxel_config->grid_size;
-
-    // Find all shard keys that intersect with the visible octree cells.
-    std::unordered_set<int> shard_keys;
-    for (auto cell : *deps.get<VisibleCells>()) {
-      octree->search(
-          [&](int64_t cell) {
-            auto [x0, y0, z0, x1, y1, z1] = octree->cellBox(cell);
-            if (x1 - x0 <= shard_size) {
-              int sx = x0 / shard_size;
-              int sy = y0 / shard_size;
-              int sz = z0 / shard_size;
-              shard_keys.insert(
-                  sx + sy * grid_size + sz * grid_size * grid_size);
-              return false;
-            } else {
-              return true;
-            }
-          },
-          cell);
-    }
+// Per frame state shared by all terrain shards in the std140 layout of the
+// FrameUniforms block of the terrain shader.
+struct TerrainFrameUniforms {
+  static constexpr unsigned kBinding = 0;
 
-    // Return the distinct keys as a vector.
-    auto ret = std::make_shared<std::vector<int>>();
-    ret->insert(ret->end(), shard_keys.begin(), shard_keys.end());
-    return ret;
-  }
+  glm::mat4 projection_matrix;
+  glm::mat4 modelview_matrix;
+  glm::mat4 normal_matrix;
+  glm::vec4 light;
 };
 
 struct TerrainShader {
   auto operator()(ResourceDeps& deps) {
     return deps.get<OpenGLExecutor>()->manage([&] {
-      return new ShaderProgram(std::vector<ShaderSource>{
+      auto shader = new ShaderProgram(std::vector<ShaderSource>{
           makeVertexShader(loadFile("shaders/terrain.vert.glsl")),
           makeFragmentShader(loadFile("shaders/terrain.frag.glsl")),
       });
+      shader->uniformBlock("FrameUniforms", TerrainFrameUniforms::kBinding);
+      return shader;
     });
   }
 };
 
+struct TerrainUniformBuffer {
+  auto operator()(ResourceDeps& deps) {
+    return deps.get<OpenGLExecutor>()->manage(
+        [&] { return new UniformBuffer(sizeof(TerrainFrameUniforms)); });
+  }
+};
+
 class TerrainRenderer {
  public:
   TerrainRenderer(
       std::shared_ptr<AsyncResources> async_resources,
       std::shared_ptr<Stats> stats)
-      : resources_(async_resources), stats_(stats) {}
+      : resources_(async_resources),
+        stats_(stats),
+        occlusion_(std::make_shared<OcclusionBuffer>(
+            kOcclusionWidth, kOcclusionHeight)),
+        shard_keys_version_(0) {}
 
   void draw() const {
     StatsUpdate stats(stats_);
@@ -439,53 +886,134 @@ class TerrainRenderer {
     auto light = resources_->syncGet<WorldLight>();
     auto camera = resources_->syncGet<WorldCamera>();
     auto shader = resources_->syncGet<TerrainShader>();
+    auto uniform_buffer = resources_->syncGet<TerrainUniformBuffer>();
+    auto color_maps = resources_->syncGet<TerrainStylesColorMap>();
+    auto normal_maps = resources_->syncGet<TerrainStylesNormalMap>();
 
     shader->run([&] {
       using namespace std::chrono_literals;
 
       // Configure OpenGL pipeline state.
-      gl::glEnable(gl::GL_DEPTH_TEST);
-      Finally finally([&] { gl::glDisable(gl::GL_DEPTH_TEST); });
-
-      // Set scene uniforms.
-      shader->uniform("light", *light);
-      shader->uniform("projection_matrix", camera->projectionMatrix());
-
-      // Render the terrain slices visible to the current camera.
-      auto shard_keys = resources_->syncGet<TerrainShardKeys>();
-      for (auto key : *shard_keys) {
-        auto opt_shard = resources_->optGet<TerrainShard>(key);
-        if (!opt_shard) {
+      glState().setDepthTest(true);
+      Finally finally([&] { glState().setDepthTest(false); });
+
+      // Upload scene uniforms once per frame. Shard vertices are in world
+      // coordinates and slice directions are vertex attributes so these are
+      // shared by all shards.
+      TerrainFrameUniforms frame;
+      frame.projection_matrix = camera->projectionMatrix();
+      frame.modelview_matrix = camera->viewMatrix();
+      frame.normal_matrix = glm::mat4(
+          glm::inverse(glm::transpose(glm::mat3(frame.modelview_matrix))));
+      frame.light = glm::vec4(*light, 0.0f);
+      uniform_buffer->update(frame);
+      uniform_buffer->bind(TerrainFrameUniforms::kBinding);
+
+      // Set texture uniforms.
+      auto color_map_handle = shader->uniformHandle<int>("color_map");
+      auto normal_map_handle = shader->uniformHandle<int>("normal_map");
+      TextureArrayBinding color_map(*color_maps->texture_array, 0);
+      TextureArrayBinding normal_map(*normal_maps->texture_array, 1);
+      shader->uniform(color_map_handle, color_map.location());
+      shader->uniform(normal_map_handle, normal_map.location());
+
+      // Order the terrain shards visible to the current camera front to back
+      // and rasterize the occluders of the nearest ones.
+      updateShardKeys(*resources_->syncGet<TerrainShardKeys>());
+      auto voxel_config = resources_->syncGet<VoxelConfig>();
+      std::vector<std::tuple<float, int, int, int>> shards;
+      shards.reserve(shard_keys_.size());
+      for (const auto& [key, level_skirts] : shard_keys_) {
+        auto [level, skirts] = level_skirts;
+        auto [x0, y0, z0, x1, y1, z1] = voxel_config->voxelBox(key);
+        auto center = 0.5f * glm::vec3(x0 + x1, y0 + y1, z0 + z1);
+        shards.emplace_back(
+            glm::distance(camera->position, center), key, level, skirts);
+      }
+      std::sort(shards.begin(), shards.end());
+      occlusion_->clear(*camera);
+      for (size_t i = 0; i < std::min(shards.size(), kOccluderShards); i += 1) {
+        auto occluders =
+            resources_->optGet<TerrainOccluders>(std::get<1>(shards[i]));
+        if (occluders && occluders.get()) {
+          for (const auto& [lo, hi] : *occluders.get()) {
+            occlusion_->addOccluder(lo, hi);
+          }
+        }
+      }
+      occlusion_->finish();
+
+      // Render the shards, skipping those hidden behind occluders and slices
+      // that face away from the camera.
+      std::vector<gl::GLint> firsts;
+      std::vector<gl::GLsizei> counts;
+      for (auto [distance, key, level, skirts] : shards) {
+        auto opt_shard = resources_->optGet<TerrainShard>(key, level, skirts);
+        if (!opt_shard || !opt_shard.get()) {
+          continue;
+        }
+        const auto& shard = *opt_shard.get();
+        if (occlusion_->isOccluded(shard.box_min, shard.box_max)) {
+          stats["terrain_occluded_shards_count"] += 1;
           continue;
         }
-        for (auto slice : opt_shard.get()->slices) {
-          // Set geometry uniforms.
-          shader->uniform("modelview_matrix", slice->modelViewMatrix(*camera));
-          shader->uniform("normal_matrix", slice->normalMatrix(*camera));
-          shader->uniform("slice_normal", slice->normal);
-          shader->uniform("slice_tangent", slice->tangent);
-          shader->uniform("slice_cotangent", slice->cotangent);
-
-          // Set texture uniforms.
-          TextureArrayBinding color_map(*slice->color_map, 0);
-          TextureArrayBinding normal_map(*slice->normal_map, 1);
-          shader->uniform("color_map", color_map.location());
-          shader->uniform("normal_map", normal_map.location());
-
-          // Draw the mesh.
-          slice->mesh.draw(*shader);
-
-          // Update stats.
-          stats["terrain_slices_count"] += 1;
+        firsts.clear();
+        counts.clear();
+        for (size_t i = 0; i < shard.dirs.size(); i += 1) {
+          auto dir = shard.dirs[i];
+          if (isTerrainSliceFacing(
+                  dir, camera->position, shard.box_min, shard.box_max)) {
+            firsts.push_back(shard.firsts[i]);
+            counts.push_back(shard.counts[i]);
+          }
         }
+        if (!counts.empty()) {
+          shard.mesh.drawRanges(firsts, counts);
+          stats["terrain_draw_calls"] += 1;
+        }
+
+        // Update stats.
+        auto culled = shard.dirs.size() - counts.size();
+        stats["terrain_slices_count"] += counts.size();
+        stats["terrain_culled_slices_count"] += culled;
         stats["terrain_shards_count"] += 1;
+        stats[format("terrain_lod_shards_count/%1%", level)] += 1;
       }
     });
   }
 
  private:
+  // Applies the deltas of the visible terrain shards, starting over from all
+  // of the visible shards after missing an update.
+  void updateShardKeys(const TerrainShardKeysUpdate& update) const {
+    if (update.version == shard_keys_version_) {
+      return;
+    }
+    if (update.previous_version != shard_keys_version_) {
+      auto tracker = resources_->syncGet<TerrainShardKeyTracker>();
+      shard_keys_.clear();
+      shard_keys_version_ = 0;
+      updateShardKeys(tracker->snapshot());
+      return;
+    }
+    for (auto key : update.removed) {
+      shard_keys_.erase(key);
+    }
+    for (auto [key, level, skirts] : update.added) {
+      shard_keys_[key] = std::pair(level, skirts);
+    }
+    shard_keys_version_ = update.version;
+  }
+
+  static constexpr int kOcclusionWidth = 256;
+  static constexpr int kOcclusionHeight = 128;
+  static constexpr size_t kOccluderShards = 64;
+
   std::shared_ptr<AsyncResources> resources_;
   std::shared_ptr<Stats> stats_;
+  std::shared_ptr<OcclusionBuffer> occlusion_;
+  mutable std::unordered_map<int, std::pair<int, int>> shard_keys_;
+  mutable uint64_t shard_keys_version_;
 };
 
 template <>
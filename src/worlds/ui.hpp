@@ -6,6 +6,7 @@
 #include <memory>
 #include <string>
 
+#include "src/common/glstate.hpp"
 #include "src/common/maps.hpp"
 #include "src/common/opengl.hpp"
 #include "src/common/registry.hpp"
@@ -67,14 +68,17 @@ struct WorldRectNode {
         (rgba >> 8 & 0xFF) / 255.0f,
         (rgba & 0xFF) / 255.0f);
 
-    return deps.get<OpenGLExecutor>()->manage([&] {
-      return new RectNode(
-          MeshBuilder()
-              .setPositions(std::move(positions))
-              .setTransform(glm::translate(glm::mat4(1.0), glm::vec3(x, y, -z)))
-              .build(),
-          std::move(color));
-    });
+    return deps.get<OpenGLExecutor>()->manage(
+        [&] {
+          return new RectNode(
+              MeshBuilder()
+                  .setPositions(std::move(positions))
+                  .setTransform(
+                      glm::translate(glm::mat4(1.0), glm::vec3(x, y, -z)))
+                  .build(),
+              std::move(color));
+        },
+        OpenGLTaskPriority::LOW);
   }
 };
 
@@ -112,12 +116,14 @@ class RectUIRenderer {
     auto node_ids = resources_->syncGet<WorldRectNodes>();
     shader->run([&] {
       shader->uniform("projection_matrix", projection);
+      auto model_matrix = shader->uniformHandle<glm::mat4>("model_matrix");
+      auto base_color = shader->uniformHandle<glm::vec4>("base_color");
       for (const auto& node_id : *node_ids) {
         if (auto opt_rect = resources_->optGet<WorldRectNode>(node_id)) {
           auto rect = opt_rect.get();
-          shader->uniform("model_matrix", rect->mesh.transform());
-          shader->uniform("base_color", rect->color);
-          rect->mesh.draw(*shader);
+          shader->uniform(model_matrix, rect->mesh.transform());
+          shader->uniform(base_color, rect->color);
+          rect->mesh.draw();
         }
       }
     });
@@ -154,14 +160,16 @@ struct WorldTextNode {
         (rgba >> 8 & 0xFF) / 255.0f,
         (rgba & 0xFF) / 255.0f);
 
-    return deps.get<OpenGLExecutor>()->manage([&] {
-      // Build the text mesh.
-      auto node = deps.get<UIFont>(font, size)->buildText(text);
-      node.mesh.transform() =
-          glm::translate(glm::mat4(1.0), glm::vec3(x, y, -z));
-      return new Text(
-          std::move(node.mesh), std::move(node.texture), std::move(color));
-    });
+    return deps.get<OpenGLExecutor>()->manage(
+        [&] {
+          // Build the text mesh.
+          auto node = deps.get<UIFont>(font, size)->buildText(text);
+          node.mesh.transform() =
+              glm::translate(glm::mat4(1.0), glm::vec3(x, y, -z));
+          return new Text(
+              std::move(node.mesh), std::move(node.texture), std::move(color));
+        },
+        OpenGLTaskPriority::LOW);
   }
 };
 
@@ -199,14 +207,17 @@ class TextUIRenderer {
     auto node_ids = resources_->syncGet<WorldTextNodes>();
     shader->run([&] {
       shader->uniform("projection_matrix", projection);
+      auto color_map = shader->uniformHandle<int>("color_map");
+      auto model_matrix = shader->uniformHandle<glm::mat4>("model_matrix");
+      auto base_color = shader->uniformHandle<glm::vec4>("base_color");
       for (const auto& node_id : *node_ids) {
         if (auto opt_text = resources_->optGet<WorldTextNode>(node_id)) {
           auto text = opt_text.get();
           TextureBinding tb(*text->texture, 0);
-          shader->uniform("color_map", tb.location());
-          shader->uniform("model_matrix", text->mesh.transform());
-          shader->uniform("base_color", text->color);
-          text->mesh.draw(*shader);
+          shader->uniform(color_map, tb.location());
+          shader->uniform(model_matrix, text->mesh.transform());
+          shader->uniform(base_color, text->color);
+          text->mesh.draw();
         }
       }
     });
@@ -285,19 +296,22 @@ struct WorldStyleNode {
     tex_coords.row(0) << 0, 1, 1, 1, 0, 0;
     tex_coords.row(1) << 0, 0, 1, 1, 1, 0;
 
-    return deps.get<OpenGLExecutor>()->manage([&] {
-      return new StyleNode(
-          MeshBuilder()
-              .setPositions(std::move(positions))
-              .setTexCoords(std::move(tex_coords))
-              .setTransform(glm::translate(glm::mat4(1.0), glm::vec3(x, y, -z)))
-              .build(),
-          std::move(color),
-          color_maps->indexOrDefault(StyleIndexKey(style, "top")),
-          normal_maps->indexOrDefault(StyleIndexKey(style, "top")),
-          color_maps->texture_array,
-          normal_maps->texture_array);
-    });
+    return deps.get<OpenGLExecutor>()->manage(
+        [&] {
+          return new StyleNode(
+              MeshBuilder()
+                  .setPositions(std::move(positions))
+                  .setTexCoords(std::move(tex_coords))
+                  .setTransform(
+                      glm::translate(glm::mat4(1.0), glm::vec3(x, y, -z)))
+                  .build(),
+              std::move(color),
+              color_maps->indexOrDefault(StyleIndexKey(style, "top")),
+              normal_maps->indexOrDefault(StyleIndexKey(style, "top")),
+              color_maps->texture_array,
+              normal_maps->texture_array);
+        },
+        OpenGLTaskPriority::LOW);
   }
 };
 
@@ -335,18 +349,24 @@ class StyleUIRenderer {
     auto node_ids = resources_->syncGet<WorldStyleNodes>();
     shader->run([&] {
       shader->uniform("projection_matrix", projection);
+      auto color_map = shader->uniformHandle<int>("color_map_array");
+      auto color_index = shader->uniformHandle<int>("color_map_array_index");
+      auto normal_map = shader->uniformHandle<int>("normal_map_array");
+      auto normal_index = shader->uniformHandle<int>("normal_map_array_index");
+      auto base_color = shader->uniformHandle<glm::vec4>("base_color");
+      auto model_matrix = shader->uniformHandle<glm::mat4>("model_matrix");
       for (const auto& node_id : *node_ids) {
         if (auto opt_node = resources_->optGet<WorldStyleNode>(node_id)) {
           auto node = opt_node.get();
           TextureArrayBinding color_map_array(*node->color_map, 0);
           TextureArrayBinding normal_map_array(*node->normal_map, 1);
-          shader->uniform("color_map_array", color_map_array.location());
-          shader->uniform("color_map_array_index", node->color_map_index);
-          shader->uniform("normal_map_array", normal_map_array.location());
-          shader->uniform("normal_map_array_index", node->normal_map_index);
-          shader->uniform("base_color", node->color);
-          shader->uniform("model_matrix", node->mesh.transform());
-          node->mesh.draw(*shader);
+          shader->uniform(color_map, color_map_array.location());
+          shader->uniform(color_index, node->color_map_index);
+          shader->uniform(normal_map, normal_map_array.location());
+          shader->uniform(normal_index, node->normal_map_index);
+          shader->uniform(base_color, node->color);
+          shader->uniform(model_matrix, node->mesh.transform());
+          node->mesh.draw();
         }
       }
     });
@@ -381,12 +401,12 @@ class UIRenderer {
     StatsTimer loop_timer(stats_, "ui_renderer");
 
     // Prepare OpenGL state.
-    gl::glDisable(gl::GL_DEPTH_TEST);
-    gl::glEnable(gl::GL_BLEND);
-    gl::glBlendFunc(gl::GL_SRC_ALPHA, gl::GL_ONE_MINUS_SRC_ALPHA);
+    glState().setDepthTest(false);
+    glState().setBlend(true);
+    glState().blendFunc(gl::GL_SRC_ALPHA, gl::GL_ONE_MINUS_SRC_ALPHA);
     Finally finally([] {
-      gl::glDisable(gl::GL_BLEND);
-      gl::glEnable(gl::GL_DEPTH_TEST);
+      glState().setBlend(false);
+      glState().setDepthTest(true);
     });
 
     // Build the orthographic projection martix.
@@ -2,11 +2,15 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <functional>
 #include <memory>
+#include <set>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
+#include "src/common/camera.hpp"
 #include "src/common/data.hpp"
 #include "src/common/maps.hpp"
 #include "src/common/resources.hpp"
@@ -61,9 +65,166 @@ struct Voxels {
     return std::make_shared<VoxelArray>(
         world_db->getObject<VoxelArray>(format("voxels/%1%", voxel_key)));
   }
+
+  // Voxels are digested by content so that derived resources persisted in
+  // earlier runs are only reused while the voxels are unchanged.
+  static uint64_t digest(const std::shared_ptr<VoxelArray>& voxels) {
+    return stableHash(serialize(*voxels));
+  }
+};
+
+// Returns the octree level of the cells spanned by voxel arrays, which is the
+// deepest level summarized by WorldOccupancy.
+inline int voxelArrayLevel(
+    const Octree& octree, const VoxelConfigData& config) {
+  int level = boost::integer_log2(octree.size() / config.voxel_size);
+  ENFORCE(octree.size() == static_cast<size_t>(config.voxel_size) << level);
+  return level;
+}
+
+// Summarizes the occupancy of the voxel arrays within a region of the world,
+// i.e. an octree cell at most kDepth levels above the voxel arrays, in the
+// order of their octree cells. Each region is stored with the world, built
+// from its own voxel arrays the first time it is used and then only updated by
+// VoxelMutator.
+struct WorldOccupancyRegion {
+  static constexpr int kDepth = 3;
+
+  static std::string tableKey(int64_t region) {
+    return format("octree_occupancy/%1%", region);
+  }
+
+  // Returns the octree level of the regions.
+  static int level(int voxel_level) {
+    return std::max(0, voxel_level - kDepth);
+  }
+
+  // Returns the region containing a cell on the voxel array level.
+  static int64_t region(int64_t cell, int voxel_level) {
+    for (int i = level(voxel_level); i < voxel_level; i += 1) {
+      cell = (cell - 1) / 8;
+    }
+    return cell;
+  }
+
+  // Returns the number of cells on the voxel array level within a region.
+  static size_t cellCount(int voxel_level) {
+    return size_t(1) << 3 * (voxel_level - level(voxel_level));
+  }
+
+  // Returns the first cell on the voxel array level within the region. The
+  // descendants of a cell on any level are numbered consecutively.
+  static int64_t firstCell(int64_t region, int voxel_level) {
+    for (int i = level(voxel_level); i < voxel_level; i += 1) {
+      region = 8 * region + 1;
+    }
+    return region;
+  }
+
+  auto operator()(ResourceDeps& deps, int64_t region) {
+    StatsTimer timer(deps.get<WorldStats>(), "world_occupancy_region");
+    auto world_db = deps.get<WorldTable>();
+    auto table_key = tableKey(region);
+    if (world_db->has(table_key)) {
+      return std::make_shared<std::vector<uint8_t>>(
+          world_db->getObject<std::vector<uint8_t>>(table_key));
+    }
+
+    auto octree = deps.get<WorldOctree>();
+    auto config = deps.get<VoxelConfig>();
+    int voxel_level = voxelArrayLevel(*octree, *config);
+    auto first = firstCell(region, voxel_level);
+    auto ret = std::make_shared<std::vector<uint8_t>>(cellCount(voxel_level));
+    for (size_t i = 0; i < ret->size(); i += 1) {
+      auto [x0, y0, z0, x1, y1, z1] = octree->cellBox(first + i);
+      auto name = format("voxels/%1%", config->voxelKey(x0, y0, z0));
+      auto occupancy = Occupancy::EMPTY;
+      if (world_db->has(name)) {
+        occupancy = voxelOccupancy(world_db->getObject<VoxelArray>(name));
+      }
+      ret->at(i) = static_cast<uint8_t>(occupancy);
+    }
+    world_db->setObject(table_key, *ret);
+    return ret;
+  }
+};
+
+// Summarizes the occupancy of octree cells down to the size of voxel arrays
+// so that empty space is skipped. The summary is assembled from the regions of
+// the world (see WorldOccupancyRegion), building any missing regions in
+// parallel.
+struct WorldOccupancy {
+  auto operator()(ResourceDeps& deps) {
+    StatsTimer timer(deps.get<WorldStats>(), "world_occupancy");
+    auto octree = deps.get<WorldOctree>();
+    auto config = deps.get<VoxelConfig>();
+    int voxel_level = voxelArrayLevel(*octree, *config);
+    int region_level = WorldOccupancyRegion::level(voxel_level);
+    int64_t first_region = 0;
+    for (int i = 0; i < region_level; i += 1) {
+      first_region = 8 * first_region + 1;
+    }
+    std::vector<int64_t> regions(int64_t(1) << 3 * region_level);
+    for (size_t i = 0; i < regions.size(); i += 1) {
+      regions[i] = first_region + i;
+    }
+    return deps.getAll<WorldOccupancyRegion>(regions).then(
+        [octree, voxel_level, regions](const auto& summaries) {
+          auto ret = std::make_shared<OctreeOccupancy>(*octree, voxel_level);
+          for (size_t i = 0; i < regions.size(); i += 1) {
+            auto first =
+                WorldOccupancyRegion::firstCell(regions[i], voxel_level);
+            const auto& summary = *summaries.at(i);
+            for (size_t j = 0; j < summary.size(); j += 1) {
+              ret->set(first + j, static_cast<Occupancy>(summary[j]));
+            }
+          }
+          return ret;
+        });
+  }
+};
+
+// Outlives camera moves so that VisibleCells is updated incrementally.
+struct VisibleCellTracker {
+  auto operator()(ResourceDeps& deps) {
+    return std::make_shared<VisibleCellSet>(
+        *deps.get<WorldOctree>(), deps.get<WorldOccupancy>());
+  }
+};
+
+struct VisibleCells {
+  auto operator()(ResourceDeps& deps) {
+    StatsUpdate stats(deps.get<WorldStats>());
+    StatsTimer timer(deps.get<WorldStats>(), "visible_cells");
+    auto tracker = deps.get<VisibleCellTracker>();
+    auto camera = deps.get<WorldCamera>();
+    auto update = tracker->update(*camera);
+    stats["visible_cells_retested"] = update.retested;
+    stats["visible_cells_added"] = update.added.size();
+    stats["visible_cells_removed"] = update.removed.size();
+    return std::make_shared<VisibleCellsUpdate>(std::move(update));
+  }
+};
+
+// Downsampled voxels for distant terrain. Each level halves the resolution of
+// the previous one, starting from the full resolution voxels at level 0.
+struct LODVoxels {
+  std::shared_ptr<CubeStore<uint32_t>> operator()(
+      ResourceDeps& deps, int voxel_key, int level) {
+    ENFORCE(level > 0);
+    StatsTimer timer(deps.get<WorldStats>(), "lod_voxels");
+    if (level == 1) {
+      auto voxels = deps.get<Voxels>(voxel_key);
+      return std::make_shared<CubeStore<uint32_t>>(downsampleVoxels(*voxels));
+    }
+    auto voxels = deps.get<LODVoxels>(voxel_key, level - 1);
+    return std::make_shared<CubeStore<uint32_t>>(downsampleVoxels(*voxels));
+  }
 };
 
 struct SurfaceVoxels {
+  static constexpr bool kPersistent = true;
+
   auto operator()(ResourceDeps& deps, int voxel_key) {
     auto voxels = deps.get<Voxels>(voxel_key);
     using SurfaceVoxels = decltype(voxels->surfaceVoxels());
@@ -72,6 +233,8 @@ struct SurfaceVoxels {
 };
 
 struct SurfaceVertices {
+  static constexpr bool kPersistent = true;
+
   auto operator()(ResourceDeps& deps, int voxel_key) {
     auto voxels = deps.get<Voxels>(voxel_key);
     using SurfaceVertices = decltype(voxels->surfaceVertices());
@@ -125,11 +288,42 @@ class VoxelMutator {
 
   ~VoxelMutator() {
     auto world_db = resources_->get<WorldTable>();
+    auto occupancy = std::make_shared<OctreeOccupancy>(
+        *resources_->get<WorldOccupancy>());
+    int voxel_level = occupancy->level();
+    std::set<int64_t> changed_regions;
+    std::vector<uint64_t> resource_keys;
     for (int voxel_key : mutated_) {
       auto va = voxel_cache_.at(voxel_key);
       world_db->setObject<VoxelArray>(format("voxels/%1%", voxel_key), *va);
-      resources_->invalidate<Voxels>(voxel_key);
+      resource_keys.push_back(resourceHash<Voxels>(voxel_key));
+
+      auto [x0, y0, z0, x1, y1, z1] = config_->voxelBox(voxel_key);
+      auto cell = octree_->cellAt(voxel_level, x0, y0, z0);
+      if (occupancy->set(cell, voxelOccupancy(*va))) {
+        changed_regions.insert(WorldOccupancyRegion::region(cell, voxel_level));
+      }
+    }
+
+    // Only store and invalidate the regions of the occupancy summary that
+    // changed since that resets visibility.
+    for (auto region : changed_regions) {
+      auto first = WorldOccupancyRegion::firstCell(region, voxel_level);
+      auto count = WorldOccupancyRegion::cellCount(voxel_level);
+      std::vector<uint8_t> summary(count);
+      for (size_t i = 0; i < summary.size(); i += 1) {
+        summary[i] = static_cast<uint8_t>(occupancy->get(first + i));
+      }
+      world_db->setObject(WorldOccupancyRegion::tableKey(region), summary);
+      resource_keys.push_back(resourceHash<WorldOccupancyRegion>(region));
+    }
+    if (changed_regions.size()) {
+      resource_keys.push_back(resourceHash<WorldOccupancy>());
     }
+
+    // Invalidate all chunks at once so that shared subscribers are only
+    // visited once.
+    resources_->invalidateMany(resource_keys);
   }
 
   bool insideWorld(float x, float y, float z) {
@@ -2,6 +2,7 @@
 
 #include <Eigen/Dense>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <unordered_set>
@@ -60,12 +61,23 @@ struct WorldLightFilterShader {
   }
 };
 
-struct WorldBlurShader {
+struct WorldBloomDownShader {
   auto operator()(ResourceDeps& deps) {
     return deps.get<OpenGLExecutor>()->manage([&] {
       return new ShaderProgram(std::vector<ShaderSource>{
           makeVertexShader(loadFile("shaders/world.vert.glsl")),
-          makeFragmentShader(loadFile("shaders/world.blur.frag.glsl")),
+          makeFragmentShader(loadFile("shaders/world.bloomdown.frag.glsl")),
+      });
+    });
+  }
+};
+
+struct WorldBloomUpShader {
+  auto operator()(ResourceDeps& deps) {
+    return deps.get<OpenGLExecutor>()->manage([&] {
+      return new ShaderProgram(std::vector<ShaderSource>{
+          makeVertexShader(loadFile("shaders/world.vert.glsl")),
+          makeFragmentShader(loadFile("shaders/world.bloomup.frag.glsl")),
       });
     });
   }
@@ -104,8 +116,18 @@ struct WorldShader {
   }
 };
 
+// The number of levels of the bloom mip chain. Each level halves the size of
+// the previous one and about doubles the radius of the glow.
+enum class BloomQuality {
+  LOW = 3,
+  MEDIUM = 5,
+  HIGH = 6,
+};
+
 class WorldRenderer {
  public:
+  static constexpr int kMaxBloomLevels = static_cast<int>(BloomQuality::HIGH);
+
   WorldRenderer(
       std::shared_ptr<Resources> resources,
       std::shared_ptr<Window> window,
@@ -114,7 +136,12 @@ class WorldRenderer {
       : resources_(resources),
         window_(window),
         sky_renderer_(sky_renderer),
-        terrain_renderer_(terrain_renderer) {}
+        terrain_renderer_(terrain_renderer),
+        bloom_quality_(BloomQuality::MEDIUM) {}
+
+  void setBloomQuality(BloomQuality quality) {
+    bloom_quality_ = quality;
+  }
 
   void updateBuffers(int width, int height, int samples) {
     // Return if no update is required.
@@ -150,12 +177,18 @@ class WorldRenderer {
         Attachments{copy_color_map_, copy_depth_map_},
         nullptr);
 
-    // Create a new texture and framebuffer to store bloom blurred scene.
-    // TODO: Use bilinear sampling over a smaller texture.
-    bloom_map1_ = std::make_shared<TextureOutput>(copy_width_, copy_height_);
-    bloom_map2_ = std::make_shared<TextureOutput>(copy_width_, copy_height_);
-    bloom_fbo1_ = std::make_shared<Framebuffer>(makeFramebuffer(bloom_map1_));
-    bloom_fbo2_ = std::make_shared<Framebuffer>(makeFramebuffer(bloom_map2_));
+    // Create a chain of textures and framebuffers to store the light filtered
+    // scene and its progressively downsampled copies for bloom.
+    bloom_maps_.clear();
+    bloom_fbos_.clear();
+    for (int level = 0; level <= kMaxBloomLevels; level += 1) {
+      auto bloom_map = std::make_shared<TextureOutput>(
+          std::max(1, copy_width_ >> level),
+          std::max(1, copy_height_ >> level));
+      bloom_fbos_.push_back(
+          std::make_shared<Framebuffer>(makeFramebuffer(bloom_map)));
+      bloom_maps_.push_back(std::move(bloom_map));
+    }
 
     // Create a new texture and framebuffer to store depth blurred scene.
     // TODO: Use bilinear sampling over a smaller texture.
@@ -203,54 +236,47 @@ class WorldRenderer {
         shader->uniform("samples", kSamplesCount);
         shader->uniform("color_map", sb.location());
         shader->uniform("depth_map", db.location());
-        frame_mesh->draw(*shader);
+        frame_mesh->draw();
       });
     }
 
     // Stage 2: Apply light filter to the scene color map copy.
     {
-      FramebufferBinding fb(*bloom_fbo1_);
+      FramebufferBinding fb(*bloom_fbos_[0]);
       gl::glViewport(0, 0, copy_width_, copy_height_);
-      gl::glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-      gl::glClear(gl::GL_COLOR_BUFFER_BIT | gl::GL_DEPTH_BUFFER_BIT);
       auto shader = resources_->get<WorldLightFilterShader>();
       shader->run([&] {
         TextureOutputBinding tb(*copy_color_map_, 0);
         shader->uniform("color_map", tb.location());
-        frame_mesh->draw(*shader);
+        frame_mesh->draw();
       });
     }
 
-    // Stage 3: Blur light-filtered scene copy to produce bloom map.
-    for (int blur_passes = 0; blur_passes < 10; blur_passes += 1) {
-      // Blur the light map horizontally.
-      {
-        FramebufferBinding fb(*bloom_fbo2_);
-        gl::glViewport(0, 0, copy_width_, copy_height_);
-        gl::glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        gl::glClear(gl::GL_COLOR_BUFFER_BIT | gl::GL_DEPTH_BUFFER_BIT);
-        auto shader = resources_->get<WorldBlurShader>();
-        shader->run([&] {
-          TextureOutputBinding tb(*bloom_map1_, 0);
-          shader->uniform("horizontal", 1);
-          shader->uniform("color_map", tb.location());
-          frame_mesh->draw(*shader);
-        });
+    // Stage 3: Blur the light-filtered scene copy to produce the bloom map by
+    // downsampling it through the bloom chain and upsampling it back (i.e. a
+    // dual Kawase filter). Every pass covers its whole target so no clears are
+    // needed.
+    auto bloom_levels = static_cast<int>(bloom_quality_);
+    auto bloomPass = [&](auto& shader, int src, int dst) {
+      FramebufferBinding fb(*bloom_fbos_[dst]);
+      auto [width, height] = bloom_maps_[dst]->dimensions();
+      gl::glViewport(0, 0, width, height);
+      shader->run([&] {
+        TextureOutputBinding tb(*bloom_maps_[src], 0);
+        shader->uniform("color_map", tb.location());
+        frame_mesh->draw();
+      });
+    };
+    {
+      auto shader = resources_->get<WorldBloomDownShader>();
+      for (int level = 1; level <= bloom_levels; level += 1) {
+        bloomPass(shader, level - 1, level);
       }
-
-      // Blur the light map vertically.
-      {
-        FramebufferBinding fb(*bloom_fbo1_);
-        gl::glViewport(0, 0, copy_width_, copy_height_);
-        gl::glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        gl::glClear(gl::GL_COLOR_BUFFER_BIT | gl::GL_DEPTH_BUFFER_BIT);
-        auto shader = resources_->get<WorldBlurShader>();
-        shader->run([&] {
-          TextureOutputBinding tb(*bloom_map2_, 0);
-          shader->uniform("horizontal", 0);
-          shader->uniform("color_map", tb.location());
-          frame_mesh->draw(*shader);
-        });
+    }
+    {
+      auto shader = resources_->get<WorldBloomUpShader>();
+      for (int level = bloom_levels - 1; level >= 0; level -= 1) {
+        bloomPass(shader, level + 1, level);
       }
     }
 
@@ -264,7 +290,7 @@ class WorldRenderer {
       shader->run([&] {
         TextureOutputBinding tb(*copy_color_map_, 0);
         shader->uniform("color_map", tb.location());
-        frame_mesh->draw(*shader);
+        frame_mesh->draw();
       });
     }
 
@@ -283,7 +309,7 @@ class WorldRenderer {
           shader->uniform("horizontal", 1);
           shader->uniform("color_map", kb.location());
           shader->uniform("depth_map", db.location());
-          frame_mesh->draw(*shader);
+          frame_mesh->draw();
         });
       }
 
@@ -300,7 +326,7 @@ class WorldRenderer {
           shader->uniform("horizontal", 0);
           shader->uniform("color_map", kb.location());
           shader->uniform("depth_map", db.location());
-          frame_mesh->draw(*shader);
+          frame_mesh->draw();
         });
       }
     }
@@ -314,14 +340,14 @@ class WorldRenderer {
       shader->run([&] {
         MultisampleTextureOutputBinding smb(*scene_map_, 0);
         MultisampleTextureOutputBinding dmb(*depth_map_, 1);
-        TextureOutputBinding bmb(*bloom_map1_, 2);
+        TextureOutputBinding bmb(*bloom_maps_[0], 2);
         TextureOutputBinding kmb(*boken_map1_, 3);
         shader->uniform("samples", kSamplesCount);
         shader->uniform("color_map", smb.location());
         shader->uniform("depth_map", dmb.location());
         shader->uniform("bloom_map", bmb.location());
         shader->uniform("boken_map", kmb.location());
-        frame_mesh->draw(*shader);
+        frame_mesh->draw();
       });
     }
   }
@@ -346,11 +372,11 @@ class WorldRenderer {
   std::shared_ptr<TextureOutput> copy_depth_map_;
   std::shared_ptr<Framebuffer> copy_fbo_;
 
-  // Post-processing buffers for generating bloom lighting.
-  std::shared_ptr<TextureOutput> bloom_map1_;
-  std::shared_ptr<TextureOutput> bloom_map2_;
-  std::shared_ptr<Framebuffer> bloom_fbo1_;
-  std::shared_ptr<Framebuffer> bloom_fbo2_;
+  // Post-processing buffers for generating bloom lighting. The first map is
+  // at the size of the scene copy and each following one is half as large.
+  BloomQuality bloom_quality_;
+  std::vector<std::shared_ptr<TextureOutput>> bloom_maps_;
+  std::vector<std::shared_ptr<Framebuffer>> bloom_fbos_;
 
   // Post-processing buffers for generating boken effect.
   std::shared_ptr<TextureOutput> boken_map1_;